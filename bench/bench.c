@@ -0,0 +1,306 @@
+/* Benchmark
+ *
+ * Runs a captured TV stream through each stage of the hot path and
+ * reports time, heap allocations and terminal output per frame:
+ *
+ *   framer  splitting the raw stream, pushed in TLS record sized pieces
+ *   decode  the single pass decoder used on the feed
+ *   chunk   the json.h DOM parser it falls back to
+ *   fen     fen_to_board
+ *   game    applying frames to the game state
+ *   render  drawing the board into a headless terminal and flushing it
+ *
+ * Allocations are those made through memstat, which covers everything
+ * litv itself allocates on these paths. The terminal is a memfd, since
+ * ncurses writes to the descriptor of its FILE directly; its size after
+ * each pass is the number of bytes drawn. The capture is read once up
+ * front and replayed for the requested number of passes.
+ *
+ * The feed path, framer, decode and fen together, is also reported in
+ * frames per second. Given -f, the benchmark fails when that falls
+ * below the floor, which is how ctest catches a throughput regression.
+ *
+ *   litv_bench [-n passes] [-f frames/s] [capture.ndjson]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "src/chunk.h"
+#include "src/decode.h"
+#include "src/fen.h"
+#include "src/framer.h"
+#include "src/game.h"
+#include "src/gfx.h"
+#include "src/memstat.h"
+
+#ifndef BENCH_CAPTURE
+#define BENCH_CAPTURE "bench/capture.ndjson"
+#endif
+
+#define BENCH_PASSES      20
+#define BENCH_RECORD_SIZE 1400
+#define BENCH_MAX_LINES   (1 << 16)
+
+typedef struct
+{
+    const char* name;
+    long long ns;
+    size_t allocs;
+    size_t bytes;
+    size_t frames;
+} stage_t;
+
+static char* capture;
+static size_t capture_len;
+static char* lines[BENCH_MAX_LINES];
+static size_t line_lens[BENCH_MAX_LINES];
+static size_t line_count;
+static frame_t frames[BENCH_MAX_LINES];
+static FILE* terminal;
+
+static long long
+now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static size_t
+take_terminal_bytes()
+{
+    int fd      = fileno(terminal);
+    off_t bytes = lseek(fd, 0, SEEK_CUR);
+    if (ftruncate(fd, 0) != 0 || lseek(fd, 0, SEEK_SET) != 0)
+        return 0;
+    return bytes > 0 ? (size_t)bytes : 0;
+}
+
+static int
+load(const char* path)
+{
+    FILE* in = fopen(path, "rb");
+    if (in == NULL)
+        return -1;
+    fseek(in, 0, SEEK_END);
+    long len = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    capture = malloc(len > 0 ? (size_t)len : 1);
+    if (capture == NULL || len <= 0 ||
+        fread(capture, 1, (size_t)len, in) != (size_t)len) {
+        fclose(in);
+        return -1;
+    }
+    fclose(in);
+    capture_len = (size_t)len;
+    return 0;
+}
+
+static void
+keep_line(void* user_data, char* line, size_t len)
+{
+    if (line_count == BENCH_MAX_LINES)
+        return;
+    lines[line_count] = malloc(len + 1);
+    memcpy(lines[line_count], line, len);
+    lines[line_count][len] = '\0';
+    line_lens[line_count++] = len;
+}
+
+static void
+count_line(void* user_data, char* line, size_t len)
+{
+    (*(size_t*)user_data)++;
+}
+
+static void
+begin(long long* start, size_t* allocs)
+{
+    *allocs = memstat_allocs();
+    *start  = now_ns();
+}
+
+static void
+end(stage_t* stage, long long start, size_t allocs, size_t frames)
+{
+    stage->ns += now_ns() - start;
+    stage->allocs += memstat_allocs() - allocs;
+    stage->frames += frames;
+}
+
+static void
+run_framer(stage_t* stage, framer_t* framer)
+{
+    long long start;
+    size_t allocs, count = 0;
+    begin(&start, &allocs);
+    for (size_t at = 0; at < capture_len; at += BENCH_RECORD_SIZE) {
+        size_t len = capture_len - at < BENCH_RECORD_SIZE ? capture_len - at
+                                                          : BENCH_RECORD_SIZE;
+        framer_push(framer, capture + at, len, count_line, &count);
+    }
+    end(stage, start, allocs, count);
+}
+
+static void
+run_decode(stage_t* stage)
+{
+    long long start;
+    size_t allocs;
+    begin(&start, &allocs);
+    for (size_t i = 0; i < line_count; i++)
+        decode_frame_fast(lines[i], line_lens[i], &frames[i]);
+    end(stage, start, allocs, line_count);
+}
+
+static void
+run_chunk(stage_t* stage)
+{
+    long long start;
+    size_t allocs;
+    frame_t frame;
+    begin(&start, &allocs);
+    for (size_t i = 0; i < line_count; i++) {
+        chunk_parse(lines[i], line_lens[i]);
+        chunk_get_frame(&frame);
+        chunk_destroy();
+    }
+    end(stage, start, allocs, line_count);
+}
+
+static void
+run_fen(stage_t* stage)
+{
+    long long start;
+    size_t allocs;
+    char board[BOARD_SIZE + 1];
+    begin(&start, &allocs);
+    for (size_t i = 0; i < line_count; i++)
+        fen_to_board(frames[i].fen, board);
+    end(stage, start, allocs, line_count);
+}
+
+static void
+run_game(stage_t* stage, game_t* game)
+{
+    long long start;
+    size_t allocs;
+    begin(&start, &allocs);
+    for (size_t i = 0; i < line_count; i++)
+        game_apply(game, &frames[i]);
+    end(stage, start, allocs, line_count);
+}
+
+static void
+run_render(stage_t* stage, game_t* game)
+{
+    long long start;
+    size_t allocs;
+    begin(&start, &allocs);
+    for (size_t i = 0; i < line_count; i++) {
+        int changed = game_apply(game, &frames[i]);
+        gfx_draw(0, game, changed);
+        gfx_flush();
+    }
+    end(stage, start, allocs, line_count);
+    stage->bytes += take_terminal_bytes();
+}
+
+int
+main(int argc, char** argv)
+{
+    int passes      = BENCH_PASSES;
+    double min_rate = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:f:")) != -1) {
+        if ((opt == 'n' && (passes = atoi(optarg)) > 0) ||
+            (opt == 'f' && (min_rate = atof(optarg)) > 0))
+            continue;
+        fprintf(
+          stderr, "usage: %s [-n passes] [-f frames/s] [capture]\n", argv[0]
+        );
+        return 1;
+    }
+    const char* path = optind < argc ? argv[optind] : BENCH_CAPTURE;
+    if (load(path) != 0) {
+        perror(path);
+        return 1;
+    }
+
+    framer_t framer;
+    framer_init(&framer);
+    for (size_t at = 0; at < capture_len; at += BENCH_RECORD_SIZE) {
+        size_t len = capture_len - at < BENCH_RECORD_SIZE ? capture_len - at
+                                                          : BENCH_RECORD_SIZE;
+        framer_push(&framer, capture + at, len, keep_line, NULL);
+    }
+    framer_reset(&framer);
+
+    int fd   = memfd_create("litv_bench", 0);
+    terminal = fd < 0 ? NULL : fdopen(fd, "w");
+    if (terminal == NULL || gfx_init_file(1, NULL, terminal) != 0) {
+        fprintf(stderr, "cannot open a headless terminal\n");
+        return 1;
+    }
+
+    stage_t stages[] = {
+        { "framer", 0, 0, 0, 0 }, { "decode", 0, 0, 0, 0 },
+        { "chunk", 0, 0, 0, 0 },  { "fen", 0, 0, 0, 0 },
+        { "game", 0, 0, 0, 0 },   { "render", 0, 0, 0, 0 },
+    };
+    game_t game, shown;
+    game_init(&game);
+    game_init(&shown);
+    take_terminal_bytes();
+    for (int pass = 0; pass < passes; pass++) {
+        run_framer(&stages[0], &framer);
+        run_decode(&stages[1]);
+        run_chunk(&stages[2]);
+        run_fen(&stages[3]);
+        run_game(&stages[4], &game);
+        run_render(&stages[5], &shown);
+    }
+    gfx_destroy();
+    fclose(terminal);
+
+    printf(
+      "%s: %zu frames, %zu bytes, %d passes\n",
+      path,
+      line_count,
+      capture_len,
+      passes
+    );
+    printf(
+      "%-8s %12s %14s %14s\n", "stage", "ns/frame", "allocs/frame", "bytes/frame"
+    );
+    for (size_t i = 0; i < sizeof(stages) / sizeof(*stages); i++) {
+        stage_t* s    = &stages[i];
+        double frames = s->frames ? (double)s->frames : 1;
+        printf(
+          "%-8s %12.1f %14.3f %14.1f\n",
+          s->name,
+          s->ns / frames,
+          s->allocs / frames,
+          s->bytes / frames
+        );
+    }
+
+    long long feed_ns = stages[0].ns + stages[1].ns + stages[3].ns;
+    double rate       = feed_ns > 0 ? stages[1].frames * 1e9 / feed_ns : 0;
+    printf("feed path %.0f frames/s\n", rate);
+
+    framer_destroy(&framer);
+    for (size_t i = 0; i < line_count; i++)
+        free(lines[i]);
+    free(capture);
+    if (min_rate > 0 && rate < min_rate) {
+        fprintf(stderr, "feed path below %.0f frames/s\n", min_rate);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+/* Opening Book Generator
+ *
+ * Compiles a text opening table into the book litv maps at start up:
+ *
+ *   ecobook TABLE BOOK
+ *
+ * TABLE has one opening per line, tab separated: the ECO code, the name
+ * and the moves from the starting position in UCI notation, separated
+ * by spaces. Blank lines, lines starting with '#' and a header line
+ * starting with "eco" are skipped. Every move is checked to be legal,
+ * and the position after the last one is what gets the name, code
+ * first. A position reached by several lines gets the last one's name.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "src/book.h"
+
+#define ECOBOOK_LINE_MAX 1024
+#define ECOBOOK_START    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -"
+
+static int
+legal(const position_t* pos, int move)
+{
+    uint16_t moves[POS_MAX_MOVES];
+    int count = pos_moves(pos, moves, 0);
+    for (int i = 0; i < count; i++)
+        if (moves[i] == move)
+            return 1;
+    return 0;
+}
+
+// the position after the moves, or -1 naming the first bad one
+static int
+play(position_t* pos, char* moves, const char* path, int line)
+{
+    pos_from_fen(pos, ECOBOOK_START);
+    for (char* uci = strtok(moves, " \r\n"); uci != NULL;
+         uci       = strtok(NULL, " \r\n")) {
+        int move = pos_pack_move(uci);
+        if (move < 0 || !legal(pos, move) || pos_apply_uci(pos, uci) != 0) {
+            fprintf(stderr, "%s:%d: illegal move %s\n", path, line, uci);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s TABLE BOOK\n", argv[0]);
+        return 2;
+    }
+    FILE* in = fopen(argv[1], "r");
+    if (in == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    book_entry_t* entries = NULL;
+    size_t count = 0, capacity = 0;
+    char text[ECOBOOK_LINE_MAX];
+    int failed = 0;
+    for (int line = 1; fgets(text, sizeof(text), in) != NULL; line++) {
+        if (text[0] == '#' || text[0] == '\n' ||
+            strncmp(text, "eco\t", 4) == 0)
+            continue;
+        char* name  = strchr(text, '\t');
+        char* moves = name != NULL ? strchr(name + 1, '\t') : NULL;
+        if (moves == NULL) {
+            fprintf(stderr, "%s:%d: expected three fields\n", argv[1], line);
+            failed = 1;
+            continue;
+        }
+        // "C65\tRuy Lopez" becomes "C65 Ruy Lopez"
+        *name    = ' ';
+        *moves++ = '\0';
+        position_t pos;
+        if (play(&pos, moves, argv[1], line) != 0) {
+            failed = 1;
+            continue;
+        }
+        if (count == capacity) {
+            capacity           = capacity ? capacity * 2 : 256;
+            book_entry_t* more = realloc(entries, capacity * sizeof(*more));
+            if (more == NULL) {
+                perror("realloc");
+                return 1;
+            }
+            entries = more;
+        }
+        entries[count].key  = pos_hash(&pos);
+        entries[count].name = strdup(text);
+        if (entries[count].name == NULL) {
+            perror("strdup");
+            return 1;
+        }
+        count++;
+    }
+    fclose(in);
+    if (failed)
+        return 1;
+
+    if (book_write(argv[2], entries, count) != 0) {
+        perror(argv[2]);
+        return 1;
+    }
+    for (size_t i = 0; i < count; i++)
+        free((void*)entries[i].name);
+    free(entries);
+    return 0;
+}
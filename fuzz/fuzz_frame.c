@@ -0,0 +1,111 @@
+/* Frame Fuzzer
+ *
+ * Feeds arbitrary bytes through everything that reads the feed: the
+ * framer, in pieces whose sizes come from the input, both decoders on
+ * every line it finds, and the FEN of every decoded frame into
+ * fen_to_board, pos_from_fen and the move generator. The input as a
+ * whole also goes straight to the FEN parsers, so their corner cases
+ * do not have to be reached through JSON.
+ *
+ * With clang this is a libFuzzer target, litv_fuzz, which keeps new
+ * inputs in the first directory and starts from all of them:
+ *
+ *   litv_fuzz CORPUS fuzz/corpus
+ *
+ * Built with FUZZ_MAIN it instead runs each file named on the command
+ * line once and exits, which is how ctest replays the corpus under the
+ * sanitizers of a Debug build with any compiler:
+ *
+ *   litv_fuzz_corpus FILE...
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "src/chunk.h"
+#include "src/decode.h"
+#include "src/fen.h"
+#include "src/framer.h"
+#include "src/position.h"
+
+static void
+check_fen(const char* fen)
+{
+    char board[BOARD_SIZE + 1];
+    position_t pos;
+    uint16_t moves[POS_MAX_MOVES];
+    fen_to_board(fen, board);
+    if (pos_from_fen(&pos, fen) == 0)
+        pos_moves(&pos, moves, 0);
+}
+
+static void
+on_line(void* user_data, char* line, size_t len)
+{
+    frame_t frame;
+    chunk_parse(line, len);
+    chunk_get_frame(&frame);
+    check_fen(frame.fen);
+    chunk_destroy();
+    if (decode_frame(line, len, &frame) == 0)
+        check_fen(frame.fen);
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    static int ready;
+    if (!ready) {
+        pos_init();
+        ready = 1;
+    }
+    // the framer and decoders take writable buffers
+    char* copy = malloc(size + 1);
+    if (copy == NULL)
+        return 0;
+    memcpy(copy, data, size);
+    copy[size] = '\0';
+
+    framer_t framer;
+    framer_init(&framer);
+    // the first byte picks where the stream is cut, as TLS records would
+    size_t piece = size > 0 ? (size_t)data[0] + 1 : 1;
+    for (size_t at = 0; at < size; at += piece) {
+        size_t len = size - at < piece ? size - at : piece;
+        framer_push(&framer, copy + at, len, on_line, NULL);
+    }
+    framer_destroy(&framer);
+
+    memcpy(copy, data, size);
+    check_fen(copy);
+    free(copy);
+    return 0;
+}
+
+#ifdef FUZZ_MAIN
+int
+main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++) {
+        FILE* in = fopen(argv[i], "rb");
+        if (in == NULL) {
+            perror(argv[i]);
+            return 1;
+        }
+        fseek(in, 0, SEEK_END);
+        long len = ftell(in);
+        fseek(in, 0, SEEK_SET);
+        uint8_t* data = malloc(len > 0 ? (size_t)len : 1);
+        if (data == NULL || len < 0 ||
+            fread(data, 1, (size_t)len, in) != (size_t)len) {
+            fprintf(stderr, "%s: cannot read\n", argv[i]);
+            return 1;
+        }
+        fclose(in);
+        LLVMFuzzerTestOneInput(data, (size_t)len);
+        free(data);
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,32 @@
+#!/bin/sh
+# report.sh size|startup BINARY BUILD_TYPE
+#
+# size prints the file and section sizes of a build, startup the mean
+# wall time of 20 runs of "BINARY --help". Run it from two build
+# directories to compare build types.
+mode=$1
+bin=$2
+type=${3:-unknown}
+
+case $mode in
+size)
+	bytes=$(wc -c < "$bin")
+	sections=$(size "$bin" 2>/dev/null | awk 'NR == 2 { print "text " $1 ", data " $2 ", bss " $3 }')
+	echo "litv ($type): $bytes bytes${sections:+, $sections}"
+	;;
+startup)
+	runs=20
+	start=$(date +%s%N)
+	i=0
+	while [ $i -lt $runs ]; do
+		"$bin" --help > /dev/null
+		i=$((i + 1))
+	done
+	end=$(date +%s%N)
+	echo "litv ($type): startup $(( (end - start) / runs / 1000 )) us"
+	;;
+*)
+	echo "usage: $0 size|startup BINARY [BUILD_TYPE]" >&2
+	exit 1
+	;;
+esac
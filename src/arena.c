@@ -0,0 +1,99 @@
+/* Bump Arena
+ *
+ * A simple region allocator for data that lives exactly as long as
+ * one feed frame. Allocations are carved out of a block by bumping
+ * an offset and are never freed individually; arena_reset makes the
+ * whole region available again.
+ *
+ * When a frame needs more than the current block, another block is
+ * chained in. On the next reset the chain is folded back into one
+ * block large enough for all of it, so after the first few frames
+ * the arena stops touching the system allocator entirely.
+ *
+ * arena_alloc has the same shape as the json.h allocator hook, so
+ * the arena can be passed straight to json_parse_ex.
+ */
+
+#include "arena.h"
+#include "memstat.h"
+
+#define ARENA_ALIGN      16
+#define ALIGN_UP(n)      (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define BLOCK_HEADER     ALIGN_UP(sizeof(arena_block_t))
+#define BLOCK_DATA(b)    ((char*)(b) + BLOCK_HEADER)
+
+static arena_block_t*
+block_new(size_t size)
+{
+    arena_block_t* block = (arena_block_t*)memstat_malloc(BLOCK_HEADER + size);
+    if (block == NULL)
+        return NULL;
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void
+arena_init(arena_t* arena)
+{
+    arena->head  = NULL;
+    arena->total = 0;
+}
+
+void*
+arena_alloc(void* user_data, size_t size)
+{
+    arena_t* arena       = (arena_t*)user_data;
+    arena_block_t* block = arena->head;
+    size                 = ALIGN_UP(size);
+
+    if (block == NULL || block->size - block->used < size) {
+        size_t block_size = ARENA_DEFAULT_BLOCK;
+        while (block_size < size)
+            block_size *= 2;
+        block = block_new(block_size);
+        if (block == NULL)
+            return NULL;
+        block->next = arena->head;
+        arena->head = block;
+        arena->total += block_size;
+    }
+
+    void* ptr = BLOCK_DATA(block) + block->used;
+    block->used += size;
+    return ptr;
+}
+
+void
+arena_reset(arena_t* arena)
+{
+    arena_block_t* block = arena->head;
+    if (block == NULL)
+        return;
+
+    if (block->next == NULL) {
+        block->used = 0;
+        return;
+    }
+
+    // fold the chain into a single block that fits everything
+    size_t total = arena->total;
+    arena_destroy(arena);
+    arena->head = block_new(total);
+    if (arena->head != NULL)
+        arena->total = total;
+}
+
+void
+arena_destroy(arena_t* arena)
+{
+    arena_block_t* block = arena->head;
+    while (block != NULL) {
+        arena_block_t* next = block->next;
+        memstat_free(block);
+        block = next;
+    }
+    arena->head  = NULL;
+    arena->total = 0;
+}
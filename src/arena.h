@@ -0,0 +1,33 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_DEFAULT_BLOCK 16384
+
+typedef struct arena_block_s
+{
+    struct arena_block_s* next;
+    size_t size;
+    size_t used;
+} arena_block_t;
+
+typedef struct
+{
+    arena_block_t* head;
+    size_t total;
+} arena_t;
+
+void
+arena_init(arena_t* arena);
+
+void*
+arena_alloc(void* arena, size_t size);
+
+void
+arena_reset(arena_t* arena);
+
+void
+arena_destroy(arena_t* arena);
+
+#endif
@@ -0,0 +1,191 @@
+/* Opening Book
+ *
+ * Names the opening of a position from a precompiled book: a hash
+ * table keyed by pos_hash, written by book_write (see eco/ecobook.c)
+ * and mapped read only at start up. Nothing is parsed or copied when
+ * the book is opened, and pages are only read in as lookups touch
+ * them, so a large book costs no more to start with than a small one.
+ *
+ * A lookup hashes the position and probes its slot. Names point into
+ * the mapping and stay valid until book_close.
+ */
+
+#include "book.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const unsigned char* data;
+static size_t size;
+static uint32_t slot_mask;
+
+static uint32_t
+get_u32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+static uint64_t
+get_u64(const unsigned char* p)
+{
+    return (uint64_t)get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+static void
+put_u32(unsigned char* p, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (unsigned char)(value >> (i * 8));
+}
+
+static void
+put_u64(unsigned char* p, uint64_t value)
+{
+    put_u32(p, (uint32_t)value);
+    put_u32(p + 4, (uint32_t)(value >> 32));
+}
+
+/* Maps the book at path. Returns -1, with no book open, when it cannot
+ * be read or is not a book.
+ */
+int
+book_open(const char* path)
+{
+    book_close();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < BOOK_HEADER_SIZE + 1) {
+        close(fd);
+        return -1;
+    }
+    size_t length = (size_t)st.st_size;
+    void* map     = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    const unsigned char* p = map;
+    uint32_t slots         = get_u32(p + 8);
+    // the names must end inside the file for lookups to hand them out
+    if (memcmp(p, BOOK_MAGIC, 4) != 0 || p[4] != BOOK_VERSION ||
+        slots == 0 || (slots & (slots - 1)) != 0 ||
+        (length - BOOK_HEADER_SIZE) / BOOK_SLOT_SIZE < slots ||
+        p[length - 1] != '\0') {
+        munmap(map, length);
+        return -1;
+    }
+    madvise(map, length, MADV_RANDOM);
+    data      = p;
+    size      = length;
+    slot_mask = slots - 1;
+    return 0;
+}
+
+/* The name of pos in the book, or NULL when it is not there or no
+ * book is open.
+ */
+const char*
+book_lookup(const position_t* pos)
+{
+    if (data == NULL)
+        return NULL;
+    uint64_t key = pos_hash(pos);
+    size_t names = BOOK_HEADER_SIZE + ((size_t)slot_mask + 1) * BOOK_SLOT_SIZE;
+    uint32_t i   = (uint32_t)key & slot_mask;
+    // a damaged book might have no empty slot to stop at
+    for (uint32_t probes = 0; probes <= slot_mask; probes++) {
+        const unsigned char* slot = data + BOOK_HEADER_SIZE +
+                                    (size_t)i * BOOK_SLOT_SIZE;
+        uint64_t found = get_u64(slot);
+        if (found == 0)
+            return NULL;
+        if (found == key) {
+            uint32_t name = get_u32(slot + 8);
+            return name >= names && name < size ? (const char*)data + name
+                                                : NULL;
+        }
+        i = (i + 1) & slot_mask;
+    }
+    return NULL;
+}
+
+void
+book_close()
+{
+    if (data != NULL)
+        munmap((void*)data, size);
+    data      = NULL;
+    size      = 0;
+    slot_mask = 0;
+}
+
+/* Writes a book of count entries to path. A key that appears more than
+ * once keeps the name of its last entry. Returns -1 on failure.
+ */
+int
+book_write(const char* path, const book_entry_t* entries, size_t count)
+{
+    uint32_t slots = 16;
+    while (slots < count * 2)
+        slots *= 2;
+    // entry index + 1 per slot, 0 for an empty one
+    size_t* table = calloc(slots, sizeof(*table));
+    if (table == NULL)
+        return -1;
+    for (size_t e = 0; e < count; e++) {
+        uint64_t key = entries[e].key;
+        uint32_t i   = (uint32_t)key & (slots - 1);
+        // 0 marks an empty slot
+        if (key == 0)
+            continue;
+        while (table[i] != 0 && entries[table[i] - 1].key != key)
+            i = (i + 1) & (slots - 1);
+        table[i] = e + 1;
+    }
+
+    size_t names  = BOOK_HEADER_SIZE + (size_t)slots * BOOK_SLOT_SIZE;
+    size_t length = names;
+    for (uint32_t i = 0; i < slots; i++)
+        if (table[i] != 0)
+            length += strlen(entries[table[i] - 1].name) + 1;
+    unsigned char* out = calloc(1, length + 1);
+    if (out == NULL || length > UINT32_MAX) {
+        free(out);
+        free(table);
+        return -1;
+    }
+    memcpy(out, BOOK_MAGIC, 4);
+    out[4] = BOOK_VERSION;
+    put_u32(out + 8, slots);
+    size_t at = names;
+    for (uint32_t i = 0; i < slots; i++) {
+        if (table[i] == 0)
+            continue;
+        const book_entry_t* entry = &entries[table[i] - 1];
+        unsigned char* slot =
+          out + BOOK_HEADER_SIZE + (size_t)i * BOOK_SLOT_SIZE;
+        put_u64(slot, entry->key);
+        put_u32(slot + 8, (uint32_t)at);
+        size_t len = strlen(entry->name) + 1;
+        memcpy(out + at, entry->name, len);
+        at += len;
+    }
+    // an empty book still ends in a zero byte
+    if (at == names)
+        length++;
+    free(table);
+
+    FILE* file = fopen(path, "wb");
+    int failed = file == NULL || fwrite(out, 1, length, file) != length;
+    if (file != NULL && fclose(file) != 0)
+        failed = 1;
+    free(out);
+    return failed ? -1 : 0;
+}
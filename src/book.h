@@ -0,0 +1,41 @@
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "position.h"
+
+/* Book format. A header of BOOK_MAGIC, a version byte, three zero
+ * bytes and a u32 slot count, a power of two. Then the slots, each a
+ * u64 pos_hash and a u32 file offset of the name, then four zero
+ * bytes; a slot with hash 0 is empty. Then the names, each ended by a
+ * zero byte, which also ends the file. All integers are little endian.
+ *
+ * A position's slot is its hash modulo the slot count, or the next
+ * one along that holds its hash, before the first empty slot. Books
+ * are written at most half full so that is nearly always the first.
+ */
+#define BOOK_MAGIC       "LECO"
+#define BOOK_VERSION     1
+#define BOOK_HEADER_SIZE 12
+#define BOOK_SLOT_SIZE   16
+
+typedef struct
+{
+    uint64_t key;
+    const char* name;
+} book_entry_t;
+
+int
+book_open(const char* path);
+
+const char*
+book_lookup(const position_t* pos);
+
+void
+book_close();
+
+int
+book_write(const char* path, const book_entry_t* entries, size_t count);
+
+#endif
@@ -11,138 +11,172 @@
  * source.
  *
  * When everything is done, we will need to call chunk_destroy to
- * free up the parsed data.
+ * release the parsed data. The DOM lives in a per-frame arena, so
+ * chunk_destroy only rewinds it and the memory is reused by the
+ * next chunk.
  */
 
 #include "chunk.h"
+#include "arena.h"
+#include <stdlib.h>
 
 static struct json_value_s* current_root;
+static arena_t frame_arena;
 
-struct json_object_element_s*
-find_element_by_name(char* name)
+/* The member called name of value, or NULL when value is not an object
+ * or has no such member. Any part of a frame can be missing or of the
+ * wrong type, so every lookup goes through here and the typed
+ * accessors.
+ */
+static struct json_value_s*
+find_member(struct json_value_s* value, const char* name)
 {
-    struct json_object_s* obj = (struct json_object_s*)current_root->payload;
-    struct json_object_element_s* cur =
-      (struct json_object_element_s*)obj->start;
-    while (strcmp(cur->name->string, name) != 0) {
-        if (cur->next != NULL) {
-            cur = cur->next;
-        } else {
-            return NULL;
-        }
-    }
-    return cur;
+    struct json_object_s* obj =
+      value != NULL ? json_value_as_object(value) : NULL;
+    if (obj == NULL)
+        return NULL;
+    for (struct json_object_element_s* cur = obj->start; cur != NULL;
+         cur                               = cur->next)
+        if (strcmp(cur->name->string, name) == 0)
+            return cur->value;
+    return NULL;
 }
 
-struct json_object_element_s*
-find_element_by_name_from(struct json_object_element_s* element, char* name)
+static const char*
+find_string(struct json_value_s* value, const char* name)
 {
-    struct json_object_s* obj = (struct json_object_s*)element;
-    struct json_object_element_s* cur =
-      (struct json_object_element_s*)obj->start;
-    while (cur != NULL && strcmp(cur->name->string, name) != 0) {
-        if (cur->next != NULL) {
-            cur = cur->next;
-        } else {
-            return NULL;
-        }
-    }
-    return cur;
+    struct json_value_s* member = find_member(value, name);
+    struct json_string_s* string =
+      member != NULL ? json_value_as_string(member) : NULL;
+    return string != NULL ? string->string : NULL;
+}
+
+static struct json_value_s*
+find_data_value(const char* name)
+{
+    return find_member(find_member(current_root, "d"), name);
 }
 
 void
 chunk_parse(char* chunk, size_t len)
 {
-    current_root = json_parse(chunk, len);
+    current_root = json_parse_ex(
+      chunk, len, json_parse_flags_default, arena_alloc, &frame_arena, NULL
+    );
 }
 
 int
 chunk_is_move_description()
 {
-    if (current_root != NULL) {
-        struct json_object_element_s* tag = find_element_by_name("t");
-        if (tag != NULL) {
-            struct json_string_s* value =
-              (struct json_string_s*)tag->value->payload;
-            return strcmp(value->string, "fen") == 0;
-        }
-    }
-    return 0;
+    const char* type = find_string(current_root, "t");
+    return type != NULL && strcmp(type, "fen") == 0;
 }
 
 const char*
 chunk_get_fen()
 {
-    if (current_root != NULL) {
-        struct json_object_element_s* data = find_element_by_name("d");
-        if (data != NULL) {
-            struct json_object_element_s* data_el =
-              (struct json_object_element_s*)data->value->payload;
-            struct json_object_element_s* fen =
-              find_element_by_name_from(data_el, "fen");
-            if (fen != NULL) {
-                struct json_string_s* fen_value =
-                  (struct json_string_s*)fen->value->payload;
-                return fen_value->string;
-            }
-        }
-    }
-    return NULL;
+    return find_string(find_member(current_root, "d"), "fen");
 }
 
-void
-parse_player(player_t* player, struct json_object_element_s* obj)
+static void
+copy_string(char* dst, size_t size, const char* src)
+{
+    strncpy(dst, src, size - 1);
+    dst[size - 1] = '\0';
+}
+
+// anything missing is left empty
+static void
+parse_player(player_t* player, struct json_value_s* value)
+{
+    player->rating[0] = '\0';
+    player->name[0]   = '\0';
+    player->title[0]  = '\0';
+
+    struct json_value_s* rating = find_member(value, "rating");
+    struct json_number_s* number =
+      rating != NULL ? json_value_as_number(rating) : NULL;
+    if (number != NULL)
+        copy_string(player->rating, sizeof(player->rating), number->number);
+    struct json_value_s* user = find_member(value, "user");
+    const char* name          = find_string(user, "name");
+    const char* title         = find_string(user, "title");
+    if (name != NULL)
+        copy_string(player->name, sizeof(player->name), name);
+    if (title != NULL)
+        copy_string(player->title, sizeof(player->title), title);
+}
+
+/* Fills players with white and black. Returns 0, leaving them alone,
+ * unless the frame lists exactly two players.
+ */
+int
+chunk_get_players(player_t* players)
+{
+    struct json_value_s* value = find_data_value("players");
+    struct json_array_s* array =
+      value != NULL ? json_value_as_array(value) : NULL;
+    if (array == NULL || array->length != 2)
+        return 0;
+    struct json_array_element_s* white = array->start;
+    struct json_array_element_s* black = white->next;
+    if (json_value_as_object(white->value) == NULL ||
+        json_value_as_object(black->value) == NULL)
+        return 0;
+    players[0].is_black = 0;
+    parse_player(&players[0], white->value);
+    players[1].is_black = 1;
+    parse_player(&players[1], black->value);
+    return 1;
+}
+
+static int
+get_data_clock(const char* name)
 {
-    player->rating =
-      json_value_as_number(find_element_by_name_from(obj, "rating")->value)
-        ->number;
-    struct json_object_element_s* user =
-      (struct json_object_element_s*)find_element_by_name_from(obj, "user")
-        ->value->payload;
-    player->name =
-      json_value_as_string(find_element_by_name_from(user, "name")->value)
-        ->string;
+    struct json_value_s* value = find_data_value(name);
+    if (value == NULL || json_value_as_number(value) == NULL)
+        return -1;
+    return atoi(json_value_as_number(value)->number);
 }
 
-player_t**
-chunk_get_players()
+static void
+get_data_string(const char* name, char* dst, size_t size)
 {
-    player_t** ret = (player_t**)malloc(2 * sizeof(player_t*));
-    ret[0]         = (player_t*)malloc(sizeof(player_t));
-    ret[1]         = (player_t*)malloc(sizeof(player_t));
-    if (current_root != NULL) {
-        struct json_object_element_s* data = find_element_by_name("d");
-        if (data != NULL) {
-            struct json_object_element_s* data_el =
-              (struct json_object_element_s*)data->value->payload;
-            struct json_object_element_s* players =
-              find_element_by_name_from(data_el, "players");
-            if (players != NULL) {
-                struct json_array_s* players_arr =
-                  json_value_as_array(players->value);
-
-                struct json_array_element_s* player_w = players_arr->start;
-                struct json_object_element_s* player_w_obj =
-                  (struct json_object_element_s*)player_w->value->payload;
-                ret[0]->is_black = 0;
-                parse_player(ret[0], player_w_obj);
-
-                struct json_array_element_s* player_b = player_w->next;
-                struct json_object_element_s* player_b_obj =
-                  (struct json_object_element_s*)player_b->value->payload;
-                ret[1]->is_black = 1;
-                parse_player(ret[1], player_b_obj);
-            }
-        }
+    struct json_value_s* value = find_data_value(name);
+    if (value != NULL && json_value_as_string(value) != NULL)
+        copy_string(dst, size, json_value_as_string(value)->string);
+}
+
+int
+chunk_get_frame(frame_t* frame)
+{
+    frame_clear(frame);
+    if (current_root == NULL)
+        return -1;
+
+    const char* type = find_string(current_root, "t");
+    if (type != NULL) {
+        if (strcmp(type, "fen") == 0)
+            frame->type = FRAME_FEN;
+        else if (strcmp(type, "featured") == 0)
+            frame->type = FRAME_FEATURED;
     }
-    return ret;
+
+    const char* fen = chunk_get_fen();
+    if (fen != NULL)
+        copy_string(frame->fen, sizeof(frame->fen), fen);
+    get_data_string("id", frame->id, sizeof(frame->id));
+    get_data_string("lm", frame->lm, sizeof(frame->lm));
+    frame->wc = get_data_clock("wc");
+    frame->bc = get_data_clock("bc");
+    if (frame->type == FRAME_FEATURED)
+        frame->has_players = chunk_get_players(frame->players);
+    return 0;
 }
 
 void
 chunk_destroy()
 {
-    if (current_root != NULL) {
-        free(current_root);
-        current_root = NULL;
-    }
+    current_root = NULL;
+    arena_reset(&frame_arena);
 }
\ No newline at end of file
@@ -3,13 +3,7 @@
 
 #include <string.h>
 #include "lib/json.h"
-
-typedef struct
-{
-    int is_black;
-    const char* name;
-    const char* rating;
-} player_t;
+#include "frame.h"
 
 void
 chunk_parse(char* chunk, size_t len);
@@ -23,7 +17,10 @@ chunk_destroy();
 const char*
 chunk_get_fen();
 
-player_t**
-chunk_get_players();
+int
+chunk_get_players(player_t* players);
+
+int
+chunk_get_frame(frame_t* frame);
 
 #endif
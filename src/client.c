@@ -0,0 +1,210 @@
+/* Client
+ *
+ * The --connect side of --serve: reads the stream a litv server sends
+ * and turns it back into frames for the normal render path, exactly
+ * like a replay that never ends. Records are decoded straight out of
+ * the receive buffer; one cut off at the end of a read stays there for
+ * the next one.
+ *
+ * client_open connects and reads the stream header before anything
+ * else starts, since the channel list decides the screen layout. When
+ * the server goes away the client reconnects with a growing delay and
+ * starts decoding afresh, as players and positions from the old
+ * connection may not match the new one. Reads and the reconnect delay
+ * are polls that also watch an eventfd, so client_stop ends client_run
+ * wherever it is waiting.
+ */
+
+#include "client.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "net.h"
+#include "stats.h"
+
+#define CLIENT_BUFFER_SIZE    (2 * RECORD_BUFFER_SIZE)
+#define CLIENT_BACKOFF_MIN_MS 500L
+#define CLIENT_BACKOFF_MAX_MS 30000L
+
+static const char* server;
+static int fd = -1;
+static int stop_fd = -1;
+static unsigned char buf[CLIENT_BUFFER_SIZE];
+static size_t len;
+static record_decoder_t decoder;
+static size_t reconnects;
+
+/* Waits up to ms, or for ever when ms is -1, for sock to be readable.
+ * Returns 1 when it is, 0 on timeout and -1 once client_stop is called.
+ */
+static int
+wait_readable(int sock, int ms)
+{
+    struct pollfd pfds[2] = {
+        { stop_fd, POLLIN, 0 },
+        { sock, POLLIN, 0 },
+    };
+    for (;;) {
+        int r = poll(pfds, 2, ms);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0 || pfds[0].revents)
+            return -1;
+        return r > 0;
+    }
+}
+
+static int
+fill()
+{
+    for (;;) {
+        if (wait_readable(fd, -1) < 0)
+            return -1;
+        ssize_t n = read(fd, buf + len, sizeof(buf) - len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        len += (size_t)n;
+        stats_add(STATS_BYTES_IN, (size_t)n);
+        stats_add(STATS_BYTES_WIRE, (size_t)n);
+        return 0;
+    }
+}
+
+static void
+consume(size_t at)
+{
+    memmove(buf, buf + at, len - at);
+    len -= at;
+}
+
+/* Connects and reads the header and channel list, leaving whatever
+ * followed them in the buffer.
+ */
+static int
+handshake(record_index_t* index)
+{
+    len = 0;
+    fd  = net_connect(server);
+    if (fd < 0)
+        return -1;
+    record_decoder_reset(&decoder);
+    for (;;) {
+        if (len >= RECORD_HEADER_SIZE &&
+            (memcmp(buf, RECORD_MAGIC, 4) != 0 || buf[4] != RECORD_VERSION))
+            break;
+        size_t at = RECORD_HEADER_SIZE;
+        record_t r;
+        if (len > at && record_read(buf, len, &at, &r) == 1) {
+            if (r.tag != RECORD_INDEX ||
+                record_read_channels(buf, &r, index) != 0)
+                break;
+            consume(at);
+            return 0;
+        }
+        if (len == sizeof(buf) || fill() != 0)
+            break;
+    }
+    close(fd);
+    fd = -1;
+    return -1;
+}
+
+int
+client_open(const char* addr, record_index_t* index)
+{
+    server = addr;
+    memset(index, 0, sizeof(*index));
+    if (stop_fd < 0)
+        stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (stop_fd < 0 || handshake(index) != 0)
+        return -1;
+    if (index->channels < 1)
+        index->channels = 1;
+    return 0;
+}
+
+// returns -1 when stopped while waiting to reconnect
+static int
+reconnect()
+{
+    static record_index_t index;
+    long delay = CLIENT_BACKOFF_MIN_MS;
+    close(fd);
+    fd = -1;
+    do {
+        // nothing to read on -1, so this only waits out the delay
+        if (wait_readable(-1, (int)delay) < 0)
+            return -1;
+        delay = delay * 2 < CLIENT_BACKOFF_MAX_MS ? delay * 2
+                                                  : CLIENT_BACKOFF_MAX_MS;
+    } while (handshake(&index) != 0);
+    reconnects++;
+    return 0;
+}
+
+/* Network thread: delivers frames from the server, with one batch per
+ * read, until client_stop.
+ */
+void
+client_run(frame_callback_t(cb_ptr), batch_callback_t(batch_ptr))
+{
+    for (;;) {
+        // what the handshake read past the header goes first
+        if (len == 0 && fill() != 0) {
+            if (reconnect() != 0)
+                break;
+            continue;
+        }
+        long long received = stats_now();
+        size_t at          = 0;
+        record_t r;
+        int result;
+        while ((result = record_read(buf, len, &at, &r)) == 1) {
+            frame_t frame;
+            long long start = stats_now();
+            int produced    = record_decode(&decoder, &r, &frame);
+            frame.decoded   = stats_now();
+            stats_time(STATS_DECODE, frame.decoded - start);
+            if (!produced)
+                continue;
+            frame.received = received;
+            cb_ptr(&frame);
+        }
+        batch_ptr();
+
+        // a record cut off by the read is short, anything longer is bad
+        if (result < 0 && len - at >= RECORD_MAX_ENCODED) {
+            if (reconnect() != 0)
+                break;
+            continue;
+        }
+        consume(at);
+        if (len > 0 && fill() != 0 && reconnect() != 0)
+            break;
+    }
+    if (fd >= 0)
+        close(fd);
+    fd = -1;
+}
+
+/* Makes client_run return. Safe from any thread once client_open has
+ * succeeded.
+ */
+void
+client_stop()
+{
+    uint64_t one = 1;
+    ssize_t n    = write(stop_fd, &one, sizeof(one));
+    (void)n;
+}
+
+size_t
+client_reconnects()
+{
+    return reconnects;
+}
@@ -0,0 +1,20 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include "feed.h"
+#include "frame.h"
+#include "record.h"
+
+int
+client_open(const char* addr, record_index_t* index);
+
+void
+client_run(frame_callback_t(cb_ptr), batch_callback_t(batch_ptr));
+
+void
+client_stop();
+
+size_t
+client_reconnects();
+
+#endif
@@ -0,0 +1,439 @@
+/* Feed Decoder
+ *
+ * The TV feed only ever sends two small, fixed shapes of message:
+ *
+ *   {"t":"featured","d":{"id":..,"players":[..],"fen":..}}
+ *   {"t":"fen","d":{"fen":..,"lm":..,"wc":..,"bc":..}}
+ *
+ * Instead of building a DOM and searching it by name, the decoder
+ * walks the bytes once and copies the fields we care about straight
+ * into a frame_t. Unknown keys are skipped, so additions to the feed
+ * are harmless.
+ *
+ * If the message does not look the way we expect (a field of the
+ * wrong type, a value too long for its buffer, broken JSON), the fast
+ * path gives up and decode_frame hands the line to the json.h based
+ * chunk parser instead.
+ */
+
+#include "decode.h"
+#include <stdlib.h>
+#include <string.h>
+#include "chunk.h"
+
+#define KEY_MAX   16
+#define MAX_DEPTH 32
+
+typedef struct
+{
+    const char* p;
+    const char* end;
+} scan_t;
+
+static size_t fallbacks;
+
+static void
+skip_ws(scan_t* s)
+{
+    while (s->p < s->end &&
+           (*s->p == ' ' || *s->p == '\t' || *s->p == '\n' || *s->p == '\r'))
+        s->p++;
+}
+
+static int
+consume(scan_t* s, char c)
+{
+    skip_ws(s);
+    if (s->p < s->end && *s->p == c) {
+        s->p++;
+        return 1;
+    }
+    return 0;
+}
+
+static int
+peek(scan_t* s)
+{
+    skip_ws(s);
+    return s->p < s->end ? *s->p : -1;
+}
+
+static int
+hex_value(int c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static int
+scan_hex4(scan_t* s, unsigned* out)
+{
+    if (s->end - s->p < 4)
+        return -1;
+    unsigned v = 0;
+    for (int i = 0; i < 4; i++) {
+        int h = hex_value((unsigned char)s->p[i]);
+        if (h < 0)
+            return -1;
+        v = v << 4 | h;
+    }
+    s->p += 4;
+    *out = v;
+    return 0;
+}
+
+static size_t
+utf8_encode(unsigned cp, char* out)
+{
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = 0xc0 | cp >> 6;
+        out[1] = 0x80 | (cp & 0x3f);
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = 0xe0 | cp >> 12;
+        out[1] = 0x80 | (cp >> 6 & 0x3f);
+        out[2] = 0x80 | (cp & 0x3f);
+        return 3;
+    }
+    out[0] = 0xf0 | cp >> 18;
+    out[1] = 0x80 | (cp >> 12 & 0x3f);
+    out[2] = 0x80 | (cp >> 6 & 0x3f);
+    out[3] = 0x80 | (cp & 0x3f);
+    return 4;
+}
+
+/* Scan a string into out (NUL terminated), or just skip it when out is
+ * NULL. Fails if the string does not fit in size bytes.
+ */
+static int
+scan_string(scan_t* s, char* out, size_t size)
+{
+    if (!consume(s, '"'))
+        return -1;
+    size_t len = 0;
+    while (s->p < s->end) {
+        char c = *s->p++;
+        char buf[4];
+        size_t n = 1;
+        if (c == '"') {
+            if (out != NULL)
+                out[len] = '\0';
+            return 0;
+        } else if ((unsigned char)c < 0x20) {
+            return -1;
+        } else if (c == '\\') {
+            if (s->p >= s->end)
+                return -1;
+            c = *s->p++;
+            switch (c) {
+                case '"':
+                case '\\':
+                case '/':
+                    buf[0] = c;
+                    break;
+                case 'b':
+                    buf[0] = '\b';
+                    break;
+                case 'f':
+                    buf[0] = '\f';
+                    break;
+                case 'n':
+                    buf[0] = '\n';
+                    break;
+                case 'r':
+                    buf[0] = '\r';
+                    break;
+                case 't':
+                    buf[0] = '\t';
+                    break;
+                case 'u': {
+                    unsigned cp, lo;
+                    if (scan_hex4(s, &cp) != 0)
+                        return -1;
+                    if (cp >= 0xd800 && cp < 0xdc00) {
+                        if (s->end - s->p < 2 || s->p[0] != '\\' ||
+                            s->p[1] != 'u')
+                            return -1;
+                        s->p += 2;
+                        if (scan_hex4(s, &lo) != 0 || lo < 0xdc00 ||
+                            lo >= 0xe000)
+                            return -1;
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                    }
+                    n = utf8_encode(cp, buf);
+                    break;
+                }
+                default:
+                    return -1;
+            }
+        } else {
+            buf[0] = c;
+        }
+        if (out != NULL) {
+            if (len + n >= size)
+                return -1;
+            memcpy(out + len, buf, n);
+        }
+        len += n;
+    }
+    return -1;
+}
+
+/* Copy the text of a JSON number, or skip it when out is NULL. */
+static int
+scan_number(scan_t* s, char* out, size_t size)
+{
+    skip_ws(s);
+    const char* start = s->p;
+    while (s->p < s->end &&
+           (*s->p == '-' || *s->p == '+' || *s->p == '.' || *s->p == 'e' ||
+            *s->p == 'E' || (*s->p >= '0' && *s->p <= '9')))
+        s->p++;
+    size_t len = s->p - start;
+    if (len == 0)
+        return -1;
+    if (out != NULL) {
+        if (len >= size)
+            return -1;
+        memcpy(out, start, len);
+        out[len] = '\0';
+    }
+    return 0;
+}
+
+static int
+scan_int(scan_t* s, int* out)
+{
+    char buf[16];
+    if (scan_number(s, buf, sizeof(buf)) != 0)
+        return -1;
+    *out = atoi(buf);
+    return 0;
+}
+
+static int
+scan_literal(scan_t* s, const char* word)
+{
+    size_t len = strlen(word);
+    skip_ws(s);
+    if ((size_t)(s->end - s->p) < len || memcmp(s->p, word, len) != 0)
+        return -1;
+    s->p += len;
+    return 0;
+}
+
+static int
+skip_value(scan_t* s, int depth)
+{
+    if (depth > MAX_DEPTH)
+        return -1;
+    switch (peek(s)) {
+        case '"':
+            return scan_string(s, NULL, 0);
+        case '{':
+            s->p++;
+            if (consume(s, '}'))
+                return 0;
+            do {
+                if (scan_string(s, NULL, 0) != 0 || !consume(s, ':') ||
+                    skip_value(s, depth + 1) != 0)
+                    return -1;
+            } while (consume(s, ','));
+            return consume(s, '}') ? 0 : -1;
+        case '[':
+            s->p++;
+            if (consume(s, ']'))
+                return 0;
+            do {
+                if (skip_value(s, depth + 1) != 0)
+                    return -1;
+            } while (consume(s, ','));
+            return consume(s, ']') ? 0 : -1;
+        case 't':
+            return scan_literal(s, "true");
+        case 'f':
+            return scan_literal(s, "false");
+        case 'n':
+            return scan_literal(s, "null");
+        default:
+            return scan_number(s, NULL, 0);
+    }
+}
+
+/* Iterate over the members of an object. Call with *first set to 1;
+ * returns 1 with the next key in key, 0 at the closing brace and -1
+ * on malformed input.
+ */
+static int
+next_key(scan_t* s, int* first, char* key)
+{
+    if (*first) {
+        *first = 0;
+        if (!consume(s, '{'))
+            return -1;
+        if (consume(s, '}'))
+            return 0;
+    } else if (!consume(s, ',')) {
+        return consume(s, '}') ? 0 : -1;
+    }
+    if (scan_string(s, key, KEY_MAX) != 0 || !consume(s, ':'))
+        return -1;
+    return 1;
+}
+
+static int
+scan_user(scan_t* s, player_t* player)
+{
+    char key[KEY_MAX];
+    int first = 1, r;
+    while ((r = next_key(s, &first, key)) == 1) {
+        if (strcmp(key, "name") == 0)
+            r = scan_string(s, player->name, sizeof(player->name));
+        else if (strcmp(key, "title") == 0 && peek(s) == '"')
+            r = scan_string(s, player->title, sizeof(player->title));
+        else
+            r = skip_value(s, 2);
+        if (r != 0)
+            return -1;
+    }
+    return r;
+}
+
+static int
+scan_player(scan_t* s, player_t* player)
+{
+    char key[KEY_MAX];
+    int first = 1, r;
+    int have_rating   = 0;
+    player->name[0]   = '\0';
+    player->title[0]  = '\0';
+    player->rating[0] = '\0';
+    while ((r = next_key(s, &first, key)) == 1) {
+        if (strcmp(key, "color") == 0) {
+            char color[8];
+            r = scan_string(s, color, sizeof(color));
+            if (r == 0)
+                player->is_black = strcmp(color, "black") == 0;
+        } else if (strcmp(key, "user") == 0) {
+            r = scan_user(s, player);
+        } else if (strcmp(key, "rating") == 0) {
+            r = scan_number(s, player->rating, sizeof(player->rating));
+            have_rating = 1;
+        } else {
+            r = skip_value(s, 2);
+        }
+        if (r != 0)
+            return -1;
+    }
+    // anything less goes to the chunk parser, which fills in blanks
+    return r == 0 && player->name[0] != '\0' && have_rating ? 0 : -1;
+}
+
+static int
+scan_players(scan_t* s, frame_t* frame)
+{
+    player_t players[2];
+    if (!consume(s, '['))
+        return -1;
+    for (int i = 0; i < 2; i++) {
+        players[i].is_black = i;
+        if ((i > 0 && !consume(s, ',')) || scan_player(s, &players[i]) != 0)
+            return -1;
+    }
+    if (!consume(s, ']'))
+        return -1;
+    int swap          = players[0].is_black && !players[1].is_black;
+    frame->players[0] = players[swap];
+    frame->players[1] = players[!swap];
+    frame->players[0].is_black = 0;
+    frame->players[1].is_black = 1;
+    frame->has_players         = 1;
+    return 0;
+}
+
+static int
+scan_data(scan_t* s, frame_t* frame)
+{
+    char key[KEY_MAX];
+    int first = 1, r;
+    while ((r = next_key(s, &first, key)) == 1) {
+        if (strcmp(key, "fen") == 0)
+            r = scan_string(s, frame->fen, sizeof(frame->fen));
+        else if (strcmp(key, "lm") == 0)
+            r = scan_string(s, frame->lm, sizeof(frame->lm));
+        else if (strcmp(key, "wc") == 0)
+            r = scan_int(s, &frame->wc);
+        else if (strcmp(key, "bc") == 0)
+            r = scan_int(s, &frame->bc);
+        else if (strcmp(key, "id") == 0)
+            r = scan_string(s, frame->id, sizeof(frame->id));
+        else if (strcmp(key, "players") == 0)
+            r = scan_players(s, frame);
+        else
+            r = skip_value(s, 1);
+        if (r != 0)
+            return -1;
+    }
+    return r;
+}
+
+int
+decode_frame_fast(const char* line, size_t len, frame_t* frame)
+{
+    scan_t s = { line, line + len };
+    char key[KEY_MAX];
+    char type[KEY_MAX];
+    int first = 1, r;
+
+    frame_clear(frame);
+    type[0] = '\0';
+    while ((r = next_key(&s, &first, key)) == 1) {
+        if (strcmp(key, "t") == 0)
+            r = scan_string(&s, type, sizeof(type));
+        else if (strcmp(key, "d") == 0)
+            r = scan_data(&s, frame);
+        else
+            r = skip_value(&s, 0);
+        if (r != 0)
+            return -1;
+    }
+    if (r != 0 || peek(&s) != -1)
+        return -1;
+
+    if (strcmp(type, "fen") == 0)
+        frame->type = FRAME_FEN;
+    else if (strcmp(type, "featured") == 0)
+        frame->type = FRAME_FEATURED;
+    if (frame->type != FRAME_UNKNOWN && frame->fen[0] == '\0')
+        return -1;
+    if (frame->type == FRAME_FEATURED && !frame->has_players)
+        return -1;
+    return 0;
+}
+
+int
+decode_frame(char* line, size_t len, frame_t* frame)
+{
+    if (decode_frame_fast(line, len, frame) == 0)
+        return 0;
+
+    fallbacks++;
+    chunk_parse(line, len);
+    int r = chunk_get_frame(frame);
+    chunk_destroy();
+    return r;
+}
+
+size_t
+decode_fallbacks()
+{
+    return fallbacks;
+}
@@ -0,0 +1,16 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stddef.h>
+#include "frame.h"
+
+int
+decode_frame_fast(const char* line, size_t len, frame_t* frame);
+
+int
+decode_frame(char* line, size_t len, frame_t* frame);
+
+size_t
+decode_fallbacks();
+
+#endif
@@ -0,0 +1,271 @@
+/* Evaluation
+ *
+ * A pool of worker threads that keeps an evaluation of the position on
+ * each board. eval_submit hands over a board's latest position; the
+ * render thread learns about results from an eventfd and collects them
+ * with eval_take. Scores are centipawns from white's point of view.
+ *
+ * Every board holds at most one job, its latest position, so work
+ * never queues up behind the game. Submitting bumps the board's
+ * generation, and a search still running on the old position sees that
+ * within a thousand nodes and gives up; a result only counts if its
+ * generation is still current. A job deepens one ply at a time, with
+ * each finished depth published at once, until EVAL_MAX_DEPTH or
+ * EVAL_NODES positions, after which the worker moves on.
+ *
+ * Boards are dealt out to workers round robin, so with several
+ * channels each worker has a few boards of its own and serves them in
+ * turn. A worker with nothing of its own to do takes the next waiting
+ * board of any other worker, so a busy channel never sits behind an
+ * idle thread. Jobs are whole searches, tens of milliseconds, so one
+ * lock around the job table costs nothing measurable.
+ */
+
+#include "eval.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "feed.h"
+#include "search.h"
+
+#define EVAL_MAX_DEPTH 8
+#define EVAL_NODES     400000
+
+typedef struct
+{
+    position_t pos;
+    // bumped by every submit, read by the search without the lock
+    atomic_uint generation;
+    int queued;
+    int home;
+    // latest result, and whether eval_take has seen it
+    int score;
+    int depth;
+    int fresh;
+} board_t;
+
+static board_t boards[FEED_MAX_CHANNELS];
+static int board_count;
+static pthread_t threads[EVAL_MAX_WORKERS];
+static int worker_count;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work  = PTHREAD_COND_INITIALIZER;
+static int stopping;
+static int wake_fd = -1;
+// where each worker looks first on its next pick, for round robin
+static int cursors[EVAL_MAX_WORKERS];
+
+static int
+same_position(const position_t* a, const position_t* b)
+{
+    return memcmp(a->mailbox, b->mailbox, BOARD_SIZE) == 0 &&
+           a->side == b->side && a->castling == b->castling && a->ep == b->ep;
+}
+
+/* The next queued board, its own boards first and then anyone's, or -1
+ * when there is none. Called with the lock held.
+ */
+static int
+pick(int worker)
+{
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < board_count; i++) {
+            int b = (cursors[worker] + i) % board_count;
+            if (!boards[b].queued || (pass == 0 && boards[b].home != worker))
+                continue;
+            cursors[worker] = (b + 1) % board_count;
+            return b;
+        }
+    }
+    return -1;
+}
+
+static void
+publish(int b, unsigned generation, int score, int depth)
+{
+    pthread_mutex_lock(&lock);
+    board_t* board = &boards[b];
+    if (atomic_load(&board->generation) == generation) {
+        board->score = score;
+        board->depth = depth;
+        board->fresh = 1;
+    }
+    pthread_mutex_unlock(&lock);
+    uint64_t one = 1;
+    ssize_t n    = write(wake_fd, &one, sizeof(one));
+    (void)n;
+}
+
+static void
+analyse(int b, const position_t* pos, unsigned generation)
+{
+    search_t search = {
+        .current    = &boards[b].generation,
+        .generation = generation,
+        .max_nodes  = EVAL_NODES,
+    };
+    int score, best = 0;
+    // positions without both kings are not chess
+    if (pos_king_square(pos, WHITE) < 0 || pos_king_square(pos, BLACK) < 0)
+        return;
+    for (int depth = 1; depth <= EVAL_MAX_DEPTH; depth++) {
+        if (search_depth(&search, pos, depth, &score, &best) != 0)
+            break;
+        publish(b, generation, pos->side == WHITE ? score : -score, depth);
+        // a forced mate does not get any more certain
+        if (score > SEARCH_MATE - SEARCH_MAX_DEPTH ||
+            score < -SEARCH_MATE + SEARCH_MAX_DEPTH)
+            break;
+    }
+}
+
+static void*
+worker_main(void* arg)
+{
+    int worker = (int)(intptr_t)arg;
+    pthread_mutex_lock(&lock);
+    while (!stopping) {
+        int b = pick(worker);
+        if (b < 0) {
+            pthread_cond_wait(&work, &lock);
+            continue;
+        }
+        boards[b].queued    = 0;
+        position_t pos      = boards[b].pos;
+        unsigned generation = atomic_load(&boards[b].generation);
+        pthread_mutex_unlock(&lock);
+        analyse(b, &pos, generation);
+        pthread_mutex_lock(&lock);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+/* Starts up to workers threads, at most EVAL_MAX_WORKERS, evaluating
+ * count boards. Returns -1 when none could be started. pos_init must
+ * have been called.
+ */
+int
+eval_start(int count, int workers)
+{
+    if (workers > EVAL_MAX_WORKERS)
+        workers = EVAL_MAX_WORKERS;
+    if (count > FEED_MAX_CHANNELS)
+        count = FEED_MAX_CHANNELS;
+    if (workers < 1 || count < 1)
+        return -1;
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0)
+        return -1;
+    board_count = count;
+    for (int i = 0; i < count; i++) {
+        boards[i].home = i % workers;
+        atomic_init(&boards[i].generation, 0);
+    }
+    for (worker_count = 0; worker_count < workers; worker_count++) {
+        cursors[worker_count] = 0;
+        if (pthread_create(
+              &threads[worker_count],
+              NULL,
+              worker_main,
+              (void*)(intptr_t)worker_count
+            ) != 0)
+            break;
+    }
+    if (worker_count == 0) {
+        close(wake_fd);
+        wake_fd = -1;
+        return -1;
+    }
+    // boards homed on a thread that failed to start are stolen
+    return 0;
+}
+
+/* Makes pos the position to evaluate on board, abandoning whatever the
+ * board was analysing before. Submitting the position already being
+ * evaluated does nothing.
+ */
+void
+eval_submit(int board, const position_t* pos)
+{
+    if (worker_count == 0 || board < 0 || board >= board_count)
+        return;
+    pthread_mutex_lock(&lock);
+    board_t* b = &boards[board];
+    if (!same_position(&b->pos, pos) ||
+        atomic_load(&b->generation) == 0) {
+        b->pos    = *pos;
+        b->queued = 1;
+        atomic_fetch_add(&b->generation, 1);
+        pthread_cond_broadcast(&work);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/* The latest score and depth for the board, and whether they changed
+ * since the last call. Until a new position has a result, they are
+ * those of the previous one.
+ */
+int
+eval_take(int board, int* score, int* depth)
+{
+    if (worker_count == 0 || board < 0 || board >= board_count)
+        return 0;
+    pthread_mutex_lock(&lock);
+    board_t* b = &boards[board];
+    int fresh  = b->fresh;
+    *score     = b->score;
+    *depth     = b->depth;
+    b->fresh   = 0;
+    pthread_mutex_unlock(&lock);
+    return fresh;
+}
+
+// readable when a result is waiting for eval_take
+int
+eval_fd()
+{
+    return wake_fd;
+}
+
+void
+eval_ack()
+{
+    uint64_t count;
+    ssize_t n = read(wake_fd, &count, sizeof(count));
+    (void)n;
+}
+
+/* Moves to mate for a score, positive when white mates, or 0 when the
+ * score is not a mate.
+ */
+int
+eval_mate(int score)
+{
+    int plies = SEARCH_MATE - (score < 0 ? -score : score);
+    if (plies > SEARCH_MAX_DEPTH + 1)
+        return 0;
+    return score < 0 ? -(plies + 1) / 2 : (plies + 1) / 2;
+}
+
+/* Stops every search and joins the workers. */
+void
+eval_stop()
+{
+    if (worker_count == 0)
+        return;
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    for (int i = 0; i < board_count; i++)
+        atomic_fetch_add(&boards[i].generation, 1);
+    pthread_cond_broadcast(&work);
+    pthread_mutex_unlock(&lock);
+    for (int i = 0; i < worker_count; i++)
+        pthread_join(threads[i], NULL);
+    worker_count = 0;
+    close(wake_fd);
+    wake_fd = -1;
+}
@@ -0,0 +1,30 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include "position.h"
+
+#define EVAL_DEFAULT_WORKERS 2
+#define EVAL_MAX_WORKERS     16
+
+int
+eval_start(int boards, int workers);
+
+void
+eval_submit(int board, const position_t* pos);
+
+int
+eval_take(int board, int* score, int* depth);
+
+int
+eval_fd();
+
+void
+eval_ack();
+
+void
+eval_stop();
+
+int
+eval_mate(int score);
+
+#endif
@@ -1,27 +1,572 @@
+/* TV Feed
+ *
+ * Streams one or more Lichess TV channels. Every channel is an easy
+ * handle on a single multi handle, so they are all driven by the same
+ * loop on the calling thread. Using HTTP/2 with PIPEWAIT lets the
+ * streams multiplex over one TLS connection instead of opening one
+ * per channel.
+ *
+ * Each channel has its own framer; complete lines are reported with
+ * the index of the channel they came from. Every encoding curl was built
+ * with is offered, so the stream, the same keys in every line, normally
+ * arrives compressed; curl inflates it as it comes in and the framer
+ * only ever sees plain text, one piece at a time.
+ *
+ * The loop is the multi handle's socket interface over epoll: curl
+ * says which sockets it wants watched and when it next needs a timeout,
+ * and the thread sleeps in epoll_wait on those sockets, a timerfd for
+ * curl's timeout and the reconnect backoff, and an eventfd feed_stop
+ * writes to. Nothing runs until one of them is ready.
+ *
+ * A stream that ends, fails or stalls (less than FEED_STALL_BYTES per
+ * second for FEED_STALL_SECONDS) is taken off the multi handle and put
+ * back after a jittered exponential backoff. The same easy handle is
+ * reused, so the reconnect goes through the multi handle's connection
+ * cache rather than starting cold. The backoff resets once a stream
+ * delivers a frame.
+ *
+ * Every channel uses one share handle for DNS and TLS sessions, so a
+ * channel that has to open its own connection resolves nothing and
+ * resumes the session another already has. Where libcurl can export
+ * sessions (8.12 and later, when built with it), they are also saved
+ * to FEED_SESSION_FILE in the user's cache directory on the way out
+ * and loaded back at start, so the next run resumes TLS instead of a
+ * full handshake. Session tickets are secrets; the file is private to
+ * the user and a stale or damaged one is only a slower start.
+ */
+
 #include "feed.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "framer.h"
+#include "stats.h"
+
+#define FEED_URL_MAX        128
+#define FEED_STALL_BYTES    1L
+#define FEED_STALL_SECONDS  60L
+#define FEED_BACKOFF_MIN_MS 500L
+#define FEED_BACKOFF_MAX_MS 60000L
+#define FEED_MAX_EVENTS     32
+#define FEED_PATH_MAX       512
+#define FEED_SESSION_FILE   "litv-tls-sessions"
+// sessions kept in the file, and the largest part of one accepted
+#define FEED_SESSIONS_MAX   8
+#define FEED_SESSION_BYTES  16384
+
+typedef struct
+{
+    int index;
+    CURL* handle;
+    framer_t framer;
+    char url[FEED_URL_MAX];
+    // connected to the multi handle, or waiting to reconnect
+    int active;
+    int attempts;
+    long long retry_at;
+    long long received_at;
+    // body bytes of the current transfer as read off the socket
+    curl_off_t wire;
+} channel_t;
 
 static fetch_callback_t(callback_fn);
+static batch_callback_t(batch_fn);
+static channel_t channels[FEED_MAX_CHANNELS];
+static size_t reconnects;
+// time spent in the line callback during the current framer_push
+static long long callback_ns;
+static long long received_at;
+static CURLM* multi;
+static CURLSH* share;
+static int epoll_fd = -1;
+static int timer_fd = -1;
+static atomic_int stop_fd = -1;
+static atomic_int stopping;
+// when curl wants its timeout, -1 for never
+static long long curl_due = -1;
+
+static long long
+now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000L;
+}
+
+static void
+on_line(void* user_data, char* line, size_t len)
+{
+    channel_t* channel = (channel_t*)user_data;
+    channel->attempts  = 0;
+    long long start    = stats_now();
+    callback_fn(channel->index, line, len);
+    callback_ns += stats_now() - start;
+}
 
 size_t
 write_callback(char* ptr, size_t size, size_t nmemb, void* userdata)
 {
-    size_t realsize = size * nmemb;
-    callback_fn(ptr, realsize);
+    channel_t* channel = (channel_t*)userdata;
+    size_t realsize    = size * nmemb;
+    long long start    = stats_now();
+    stats_add(STATS_BYTES_IN, realsize);
+    curl_off_t wire = 0;
+    if (curl_easy_getinfo(channel->handle, CURLINFO_SIZE_DOWNLOAD_T, &wire) ==
+          CURLE_OK &&
+        wire > channel->wire) {
+        stats_add(STATS_BYTES_WIRE, (size_t)(wire - channel->wire));
+        channel->wire = wire;
+    }
+    if (channel->received_at)
+        stats_time(STATS_RECEIVE, start - channel->received_at);
+    channel->received_at = start;
+    received_at          = start;
+
+    // framing is what is left once decoding the lines is taken out
+    callback_ns  = 0;
+    size_t lines =
+      framer_push(&channel->framer, ptr, realsize, on_line, channel);
+    stats_time(STATS_FRAMING, stats_now() - start - callback_ns);
+    if (lines > 0 && batch_fn)
+        batch_fn();
     return realsize;
 }
 
-void
-feed_init(fetch_callback_t(cb_ptr))
+static void
+channel_url(char* url, const char* name)
+{
+    // the plain feed follows the top rated game
+    if (name == NULL || strcmp(name, "top") == 0)
+        snprintf(url, FEED_URL_MAX, "%s", LICHESS_TV_URL);
+    else
+        snprintf(url, FEED_URL_MAX, LICHESS_CHANNEL_URL, name);
+}
+
+static void
+channel_open(channel_t* channel, int index, const char* name)
 {
-    callback_fn  = cb_ptr;
+    channel->index = index;
+    channel_url(channel->url, name);
+    framer_init(&channel->framer);
+
     CURL* handle = curl_easy_init();
     curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2_0);
-    curl_easy_setopt(handle, CURLOPT_URL, LICHESS_TV_URL);
+    curl_easy_setopt(handle, CURLOPT_URL, channel->url);
+    // an empty list offers every encoding curl supports
+    curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, "");
     curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, channel);
+    curl_easy_setopt(handle, CURLOPT_PRIVATE, channel);
     curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_LIMIT, FEED_STALL_BYTES);
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_TIME, FEED_STALL_SECONDS);
+    if (share != NULL)
+        curl_easy_setopt(handle, CURLOPT_SHARE, share);
+    channel->handle = handle;
+    channel->active = 1;
+}
+
+/* Full jitter: wait a random time between half and all of the current
+ * backoff step. Being rate limited always waits the maximum.
+ */
+static long
+backoff_ms(channel_t* channel)
+{
+    long code = 0;
+    curl_easy_getinfo(channel->handle, CURLINFO_RESPONSE_CODE, &code);
+    if (code == 429)
+        return FEED_BACKOFF_MAX_MS;
+
+    long step = FEED_BACKOFF_MIN_MS;
+    for (int i = 0; i < channel->attempts && step < FEED_BACKOFF_MAX_MS; i++)
+        step *= 2;
+    if (step > FEED_BACKOFF_MAX_MS)
+        step = FEED_BACKOFF_MAX_MS;
+    return step / 2 + rand() % (step / 2 + 1);
+}
+
+static void
+channel_done(CURLM* multi, channel_t* channel)
+{
+    curl_multi_remove_handle(multi, channel->handle);
+    framer_reset(&channel->framer);
+    channel->wire     = 0;
+    channel->retry_at = now_ms() + backoff_ms(channel);
+    channel->active   = 0;
+    channel->attempts++;
+}
+
+static void
+reap(CURLM* multi)
+{
+    CURLMsg* msg;
+    int left;
+    while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+        channel_t* channel = NULL;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &channel);
+        if (channel != NULL)
+            channel_done(multi, channel);
+    }
+}
+
+/* Put channels whose backoff has expired back on the multi handle and
+ * return when the next one is due, -1 if none is waiting.
+ */
+static long long
+revive(CURLM* multi, int count)
+{
+    long long now = now_ms();
+    long long due = -1;
+    for (int i = 0; i < count; i++) {
+        channel_t* channel = &channels[i];
+        if (channel->active)
+            continue;
+        if (channel->retry_at <= now) {
+            curl_multi_add_handle(multi, channel->handle);
+            channel->active = 1;
+            reconnects++;
+        } else if (due < 0 || channel->retry_at < due) {
+            due = channel->retry_at;
+        }
+    }
+    return due;
+}
+
+// CURLMOPT_SOCKETFUNCTION: keeps the epoll set in step with curl
+static int
+on_socket(CURL* easy, curl_socket_t s, int what, void* userp, void* socketp)
+{
+    if (what == CURL_POLL_REMOVE) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s, NULL);
+        return 0;
+    }
+    struct epoll_event event = { 0 };
+    event.data.fd            = s;
+    if (what & CURL_POLL_IN)
+        event.events |= EPOLLIN;
+    if (what & CURL_POLL_OUT)
+        event.events |= EPOLLOUT;
+    if (socketp != NULL)
+        return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, s, &event) == 0 ? 0 : -1;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, s, &event) != 0)
+        return -1;
+    curl_multi_assign(multi, s, &epoll_fd);
+    return 0;
+}
 
-    curl_easy_perform(handle);
+// CURLMOPT_TIMERFUNCTION: only noted here, armed by arm_timer
+static int
+on_timer(CURLM* m, long timeout_ms, void* userp)
+{
+    curl_due = timeout_ms < 0 ? -1 : now_ms() + timeout_ms;
+    return 0;
+}
+
+// sets the timerfd to the earlier of curl's timeout and due, if any
+static void
+arm_timer(long long due)
+{
+    if (curl_due >= 0 && (due < 0 || curl_due < due))
+        due = curl_due;
+    struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+    if (due >= 0) {
+        // a time already past fires at once, but zero would disarm
+        spec.it_value.tv_sec  = (time_t)(due / 1000);
+        spec.it_value.tv_nsec = due % 1000 * 1000000L + 1;
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+static int
+open_loop()
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    int stop = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    atomic_store(&stop_fd, stop);
+    if (epoll_fd < 0 || timer_fd < 0 || stop < 0)
+        return -1;
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = timer_fd };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event) != 0)
+        return -1;
+    event.data.fd = stop;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop, &event);
+}
+
+static void
+close_loop()
+{
+    int stop = atomic_exchange(&stop_fd, -1);
+    if (stop >= 0)
+        close(stop);
+    if (timer_fd >= 0)
+        close(timer_fd);
+    if (epoll_fd >= 0)
+        close(epoll_fd);
+    timer_fd = epoll_fd = -1;
+}
 
-    curl_easy_cleanup(handle);
+static int
+socket_mask(uint32_t events)
+{
+    int mask = 0;
+    if (events & EPOLLIN)
+        mask |= CURL_CSELECT_IN;
+    if (events & EPOLLOUT)
+        mask |= CURL_CSELECT_OUT;
+    if (events & (EPOLLERR | EPOLLHUP))
+        mask |= CURL_CSELECT_ERR;
+    return mask;
+}
+
+// runs until feed_stop or a failure of the multi handle
+static void
+run(int count)
+{
+    struct epoll_event events[FEED_MAX_EVENTS];
+    int running;
+    arm_timer(revive(multi, count));
+    while (!atomic_load(&stopping)) {
+        int n = epoll_wait(epoll_fd, events, FEED_MAX_EVENTS, -1);
+        if (n < 0 && errno != EINTR)
+            return;
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            CURLMcode code;
+            if (fd == atomic_load(&stop_fd))
+                return;
+            if (fd == timer_fd) {
+                uint64_t expired;
+                // the timer may have been for a reconnect
+                if (read(timer_fd, &expired, sizeof(expired)) < 0 ||
+                    curl_due < 0 || curl_due > now_ms())
+                    continue;
+                curl_due = -1;
+                code     = curl_multi_socket_action(
+                  multi, CURL_SOCKET_TIMEOUT, 0, &running
+                );
+            } else {
+                code = curl_multi_socket_action(
+                  multi, fd, socket_mask(events[i].events), &running
+                );
+            }
+            if (code != CURLM_OK)
+                return;
+        }
+        reap(multi);
+        arm_timer(revive(multi, count));
+    }
+}
+
+#if LIBCURL_VERSION_NUM >= 0x080c00
+/* Where TLS sessions are kept between runs, or -1 when there is no
+ * cache directory to put them in.
+ */
+static int
+session_path(char* path, size_t size)
+{
+    const char* cache = getenv("XDG_CACHE_HOME");
+    const char* home  = getenv("HOME");
+    int n;
+    if (cache != NULL && cache[0] == '/')
+        n = snprintf(path, size, "%s/%s", cache, FEED_SESSION_FILE);
+    else if (home != NULL && home[0] == '/')
+        n = snprintf(path, size, "%s/.cache/%s", home, FEED_SESSION_FILE);
+    else
+        return -1;
+    return n > 0 && (size_t)n < size ? 0 : -1;
+}
+
+/* The file is a series of sessions, each the u32 lengths of curl's
+ * salted key hash and of the session data, then the two. It never
+ * leaves this machine, so the lengths are in host byte order.
+ */
+static int
+read_part(FILE* file, unsigned char* buf, uint32_t len)
+{
+    return len > 0 && len <= FEED_SESSION_BYTES &&
+           fread(buf, 1, len, file) == len;
+}
+
+static void
+load_sessions(CURL* handle)
+{
+    char path[FEED_PATH_MAX];
+    if (session_path(path, sizeof(path)) != 0)
+        return;
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return;
+    static unsigned char shmac[FEED_SESSION_BYTES];
+    static unsigned char sdata[FEED_SESSION_BYTES];
+    uint32_t lens[2];
+    int count = 0;
+    while (count++ < FEED_SESSIONS_MAX &&
+           fread(lens, sizeof(lens[0]), 2, file) == 2 &&
+           read_part(file, shmac, lens[0]) && read_part(file, sdata, lens[1]))
+        curl_easy_ssls_import(handle, NULL, shmac, lens[0], sdata, lens[1]);
+    fclose(file);
+}
+
+typedef struct
+{
+    FILE* file;
+    int count;
+} session_writer_t;
+
+static CURLcode
+save_session(
+  CURL* handle,
+  void* userptr,
+  const char* session_key,
+  const unsigned char* shmac,
+  size_t shmac_len,
+  const unsigned char* sdata,
+  size_t sdata_len,
+  curl_off_t valid_until,
+  int ietf_tls_id,
+  const char* alpn,
+  size_t earlydata_max
+)
+{
+    session_writer_t* writer = userptr;
+    if (writer->count >= FEED_SESSIONS_MAX || shmac_len == 0 ||
+        shmac_len > FEED_SESSION_BYTES || sdata_len > FEED_SESSION_BYTES ||
+        (valid_until > 0 && valid_until < time(NULL)))
+        return CURLE_OK;
+    uint32_t lens[2] = { (uint32_t)shmac_len, (uint32_t)sdata_len };
+    fwrite(lens, sizeof(lens[0]), 2, writer->file);
+    fwrite(shmac, 1, shmac_len, writer->file);
+    fwrite(sdata, 1, sdata_len, writer->file);
+    writer->count++;
+    return CURLE_OK;
+}
+
+// written next to the old file and renamed over it, readable by no one else
+static void
+save_sessions(CURL* handle)
+{
+    char path[FEED_PATH_MAX], next[FEED_PATH_MAX + 4];
+    if (session_path(path, sizeof(path)) != 0)
+        return;
+    snprintf(next, sizeof(next), "%s.new", path);
+    int fd = open(next, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return;
+    session_writer_t writer = { fdopen(fd, "wb"), 0 };
+    if (writer.file == NULL) {
+        close(fd);
+        unlink(next);
+        return;
+    }
+    CURLcode code = curl_easy_ssls_export(handle, save_session, &writer);
+    int failed    = fclose(writer.file) != 0;
+    if (code != CURLE_OK || failed || writer.count == 0 ||
+        rename(next, path) != 0)
+        unlink(next);
+}
+#else
+// this libcurl cannot hand sessions out, so they last one run
+static void
+load_sessions(CURL* handle)
+{
+}
+
+static void
+save_sessions(CURL* handle)
+{
+}
+#endif
+
+void
+feed_init(
+  const char** names,
+  int count,
+  fetch_callback_t(cb_ptr),
+  batch_callback_t(batch_ptr)
+)
+{
+    callback_fn = cb_ptr;
+    batch_fn    = batch_ptr;
+    if (count < 1)
+        count = 1;
+    if (count > FEED_MAX_CHANNELS)
+        count = FEED_MAX_CHANNELS;
+
+    multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, on_socket);
+    curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, on_timer);
+    // only this thread uses the share, so it needs no lock functions
+    share = curl_share_init();
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    if (open_loop() == 0) {
+        for (int i = 0; i < count; i++) {
+            const char* name = names ? names[i] : NULL;
+            channel_open(&channels[i], i, name);
+        }
+        load_sessions(channels[0].handle);
+        for (int i = 0; i < count; i++)
+            curl_multi_add_handle(multi, channels[i].handle);
+        srand((unsigned)(time(NULL) ^ getpid()));
+        // a feed_stop before the eventfd existed is seen here
+        if (!atomic_load(&stopping))
+            run(count);
+    }
+
+    if (channels[0].handle != NULL)
+        save_sessions(channels[0].handle);
+    for (int i = 0; i < count; i++) {
+        if (channels[i].active)
+            curl_multi_remove_handle(multi, channels[i].handle);
+        curl_easy_cleanup(channels[i].handle);
+        framer_destroy(&channels[i].framer);
+    }
+    curl_multi_cleanup(multi);
+    curl_share_cleanup(share);
+    share = NULL;
     curl_global_cleanup();
+    close_loop();
+}
+
+/* Makes feed_init return. Safe from any thread, at any time. */
+void
+feed_stop()
+{
+    atomic_store(&stopping, 1);
+    int stop = atomic_load(&stop_fd);
+    if (stop >= 0) {
+        uint64_t one = 1;
+        ssize_t n    = write(stop, &one, sizeof(one));
+        (void)n;
+    }
+}
+
+size_t
+feed_reconnects()
+{
+    return reconnects;
+}
+
+/* When the chunk being framed came off the socket. Only meaningful
+ * from the line callback.
+ */
+long long
+feed_received_at()
+{
+    return received_at;
 }
@@ -4,8 +4,26 @@
 #include <curl/curl.h>
 
 #define LICHESS_TV_URL       "https://lichess.org/api/tv/feed"
-#define fetch_callback_t(fn) void (*fn)(char*, size_t)
+#define LICHESS_CHANNEL_URL  "https://lichess.org/api/tv/%s/feed"
+#define FEED_MAX_CHANNELS    16
+#define fetch_callback_t(fn) void (*fn)(int, char*, size_t)
+#define batch_callback_t(fn) void (*fn)(void)
 
-void feed_init(fetch_callback_t(cb_ptr));
+void
+feed_init(
+  const char** channels,
+  int count,
+  fetch_callback_t(cb_ptr),
+  batch_callback_t(batch_ptr)
+);
+
+void
+feed_stop();
+
+size_t
+feed_reconnects();
+
+long long
+feed_received_at();
 
 #endif
@@ -1,27 +1,40 @@
 #include "fen.h"
-#include <ctype.h>
-#include <stdlib.h>
 #include "lib/debug.h"
 
-#define BOARD_SIZE 64
-
-char*
-fen_to_board(char* fen)
+/* Decode the piece placement field of a FEN into board, one char per
+ * square from a8 to h1 with '.' for empty squares. The board must have
+ * room for BOARD_SIZE + 1 chars and is always NUL terminated. Returns
+ * -1 unless the placement is eight ranks of exactly eight squares each,
+ * made of piece letters and the digits 1 to 8; whatever was decoded
+ * before the error is left on the board.
+ *
+ * Crazyhouse pockets ("[...]") and promoted piece markers ('~') are
+ * accepted and ignored.
+ */
+int
+fen_to_board(const char* fen, char* board)
 {
-    char* board = (char*)malloc(sizeof(char) * (BOARD_SIZE + 1));
     memset(board, '.', sizeof(char) * BOARD_SIZE);
-    char* placement = strtok(fen, " ");
-    size_t p_pos    = 0;
-    size_t b_pos    = 0;
-    for (p_pos = 0; placement[p_pos] != '\0'; p_pos++) {
-        if (placement[p_pos] != '/') {
-            if (isdigit(placement[p_pos])) {
-                b_pos += placement[p_pos] - '0';
-            } else {
-                board[b_pos++] = placement[p_pos];
-            }
+    board[BOARD_SIZE] = '\0';
+    int rank          = 0;
+    int file          = 0;
+    for (const char* c = fen; *c != '\0' && *c != ' ' && *c != '['; c++) {
+        if (*c == '~')
+            continue;
+        if (*c == '/') {
+            if (file != 8 || rank == 7)
+                return -1;
+            rank++;
+            file = 0;
+        } else if (*c >= '1' && *c <= '8') {
+            file += *c - '0';
+            if (file > 8)
+                return -1;
+        } else if (strchr("PNBRQKpnbrqk", *c) != NULL && file < 8) {
+            board[rank * 8 + file++] = *c;
+        } else {
+            return -1;
         }
     }
-    board[b_pos] = '\0';
-    return board;
-}
\ No newline at end of file
+    return rank == 7 && file == 8 ? 0 : -1;
+}
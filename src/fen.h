@@ -3,7 +3,9 @@
 
 #include <string.h>
 
-char*
-fen_to_board(char* fen);
+#define BOARD_SIZE 64
 
-#endif
\ No newline at end of file
+int
+fen_to_board(const char* fen, char* board);
+
+#endif
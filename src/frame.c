@@ -0,0 +1,15 @@
+#include "frame.h"
+
+void
+frame_clear(frame_t* frame)
+{
+    frame->type        = FRAME_UNKNOWN;
+    frame->id[0]       = '\0';
+    frame->fen[0]      = '\0';
+    frame->lm[0]       = '\0';
+    frame->wc          = -1;
+    frame->bc          = -1;
+    frame->has_players = 0;
+    frame->received    = 0;
+    frame->decoded     = 0;
+}
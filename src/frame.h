@@ -0,0 +1,51 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#define PLAYER_NAME_MAX   32
+#define PLAYER_TITLE_MAX  8
+#define PLAYER_RATING_MAX 8
+
+#define FRAME_ID_MAX  16
+#define FRAME_FEN_MAX 128
+#define FRAME_LM_MAX  8
+
+#define FRAME_UNKNOWN  0
+#define FRAME_FEATURED 1
+#define FRAME_FEN      2
+
+typedef struct
+{
+    int is_black;
+    char name[PLAYER_NAME_MAX];
+    char title[PLAYER_TITLE_MAX];
+    char rating[PLAYER_RATING_MAX];
+} player_t;
+
+/* One decoded message from the TV feed. A "featured" frame announces
+ * a new game with its players, a "fen" frame carries a move. Clocks
+ * are in seconds and are -1 when the frame has none. channel is the
+ * index of the feed the frame came from. received and decoded are
+ * monotonic nanoseconds for when its bytes came off the socket and
+ * when decoding finished.
+ */
+typedef struct
+{
+    int type;
+    int channel;
+    char id[FRAME_ID_MAX];
+    char fen[FRAME_FEN_MAX];
+    char lm[FRAME_LM_MAX];
+    int wc;
+    int bc;
+    int has_players;
+    player_t players[2];
+    long long received;
+    long long decoded;
+} frame_t;
+
+#define frame_callback_t(fn) void (*fn)(frame_t*)
+
+void
+frame_clear(frame_t* frame);
+
+#endif
@@ -0,0 +1,127 @@
+/* NDJSON Framer
+ *
+ * The Lichess feed is a stream of JSON documents separated by '\n',
+ * but libcurl hands us whatever the socket returned: half a frame,
+ * several frames, or a frame and a half. The framer turns those
+ * buffers back into complete lines.
+ *
+ * Lines that are fully contained in the incoming buffer are passed
+ * to the callback straight from that buffer, without copying. Only
+ * the trailing partial line is carried over into our own buffer,
+ * which is reused (and grown when needed) for the life of the
+ * framer. Since the carry is always drained as soon as its newline
+ * shows up, it never wraps and is kept linear.
+ *
+ * Empty lines are keep-alives and are not reported.
+ */
+
+#include "framer.h"
+#include "memstat.h"
+#include <string.h>
+
+static size_t
+emit(char* line, size_t len, line_callback_t(cb), void* user_data)
+{
+    if (len > 0 && line[len - 1] == '\r')
+        len--;
+    if (len == 0)
+        return 0;
+    cb(user_data, line, len);
+    return 1;
+}
+
+static int
+carry(framer_t* framer, const char* data, size_t len)
+{
+    if (framer->discarding)
+        return 0;
+    if (framer->len + len > FRAMER_MAX_LINE) {
+        // runaway line, drop it until the next newline
+        framer->len        = 0;
+        framer->discarding = 1;
+        return 0;
+    }
+    if (framer->len + len > framer->capacity) {
+        size_t capacity = framer->capacity ? framer->capacity : 1;
+        while (capacity < framer->len + len)
+            capacity *= 2;
+        char* grown = (char*)memstat_realloc(framer->data, capacity);
+        if (grown == NULL) {
+            // a line missing this piece must not reach the decoders
+            framer->len        = 0;
+            framer->discarding = 1;
+            return -1;
+        }
+        framer->data     = grown;
+        framer->capacity = capacity;
+    }
+    memcpy(framer->data + framer->len, data, len);
+    framer->len += len;
+    return 0;
+}
+
+void
+framer_init(framer_t* framer)
+{
+    framer->data       = (char*)memstat_malloc(FRAMER_INITIAL_CAPACITY);
+    framer->capacity   = framer->data ? FRAMER_INITIAL_CAPACITY : 0;
+    framer->len        = 0;
+    framer->discarding = 0;
+}
+
+size_t
+framer_push(
+  framer_t* framer,
+  char* data,
+  size_t len,
+  line_callback_t(cb),
+  void* user_data
+)
+{
+    size_t lines = 0;
+    char* end    = data + len;
+    char* nl     = memchr(data, '\n', len);
+
+    if (nl == NULL) {
+        carry(framer, data, len);
+        return 0;
+    }
+
+    // complete the line started by a previous buffer
+    if (framer->len > 0 || framer->discarding) {
+        if (carry(framer, data, nl - data) == 0 && !framer->discarding) {
+            lines += emit(framer->data, framer->len, cb, user_data);
+        }
+        framer->len        = 0;
+        framer->discarding = 0;
+        data               = nl + 1;
+        nl                 = memchr(data, '\n', end - data);
+    }
+
+    // every other complete line is handed out in place
+    while (nl != NULL) {
+        lines += emit(data, nl - data, cb, user_data);
+        data = nl + 1;
+        nl   = memchr(data, '\n', end - data);
+    }
+
+    if (data < end)
+        carry(framer, data, end - data);
+    return lines;
+}
+
+void
+framer_reset(framer_t* framer)
+{
+    framer->len        = 0;
+    framer->discarding = 0;
+}
+
+void
+framer_destroy(framer_t* framer)
+{
+    memstat_free(framer->data);
+    framer->data     = NULL;
+    framer->capacity = 0;
+    framer->len      = 0;
+}
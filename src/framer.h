@@ -0,0 +1,37 @@
+#ifndef FRAMER_H
+#define FRAMER_H
+
+#include <stddef.h>
+
+#define FRAMER_INITIAL_CAPACITY 4096
+#define FRAMER_MAX_LINE         (1 << 20)
+
+#define line_callback_t(fn) void (*fn)(void*, char*, size_t)
+
+typedef struct
+{
+    char* data;
+    size_t capacity;
+    size_t len;
+    int discarding;
+} framer_t;
+
+void
+framer_init(framer_t* framer);
+
+size_t
+framer_push(
+  framer_t* framer,
+  char* data,
+  size_t len,
+  line_callback_t(cb),
+  void* user_data
+);
+
+void
+framer_reset(framer_t* framer);
+
+void
+framer_destroy(framer_t* framer);
+
+#endif
@@ -0,0 +1,162 @@
+/* Game State
+ *
+ * The state of the game currently on screen. It is owned by the
+ * caller and updated in place from decoded frames, so watching a
+ * game does not allocate per move.
+ *
+ * Moves are applied incrementally from the frame's lm field. The
+ * frame's FEN is only used to check the result, and to rebuild the
+ * position when a new game starts or the two have drifted apart.
+ *
+ * The feed has no server timestamps, but its clocks say how long each
+ * player thought. Adding that up gives the game's own time line, and
+ * arrival time minus that stays constant while the feed keeps up. The
+ * lag is how far it has grown past the best seen in this game. Clocks
+ * are whole seconds and the increment is only inferred (as the largest
+ * gain seen on a move), so this is a coarse, second level estimate.
+ *
+ * Every move that was applied incrementally also goes into the game's
+ * history. A new game, or a position that had to be rebuilt from the
+ * FEN, starts the history afresh from there.
+ *
+ * Every position is looked up in the opening book. The opening shown
+ * is that of the last position found, so it stays once the game has
+ * left the book.
+ */
+
+#include "game.h"
+#include "book.h"
+
+void
+game_init(game_t* game)
+{
+    memset(game, 0, sizeof(*game));
+    memset(game->pos.mailbox, '.', BOARD_SIZE);
+    game->pos.ep              = -1;
+    game->wc                  = -1;
+    game->bc                  = -1;
+    game->check               = -1;
+    game->players[1].is_black = 1;
+    history_reset(&game->history, &game->pos);
+}
+
+static int
+update_position(game_t* game, const frame_t* frame)
+{
+    if (frame->type == FRAME_FEN && frame->lm[0] != '\0') {
+        position_t next = game->pos;
+        if (pos_apply_uci(&next, frame->lm) == 0 &&
+            pos_matches_fen(&next, frame->fen)) {
+            game->pos = next;
+            history_push(&game->history, frame->lm);
+            return 0;
+        }
+    }
+    if (pos_matches_fen(&game->pos, frame->fen)) {
+        if (frame->type == FRAME_FEATURED)
+            history_reset(&game->history, &game->pos);
+        return 0;
+    }
+
+    position_t fresh;
+    if (pos_from_fen(&fresh, frame->fen) != 0)
+        return -1;
+    game->pos = fresh;
+    history_reset(&game->history, &game->pos);
+    if (frame->type == FRAME_FEN)
+        game->resyncs++;
+    return 0;
+}
+
+static void
+update_lag(game_t* game, const frame_t* frame)
+{
+    if (frame->wc < 0 || frame->bc < 0 || frame->received == 0)
+        return;
+    if (game->timed++ > 0 && game->wc >= 0 && game->bc >= 0) {
+        // the side that just moved is the one not on move now
+        int white = game->pos.side == BLACK;
+        int delta = white ? frame->wc - game->wc : frame->bc - game->bc;
+        if (delta > game->increment)
+            game->increment = delta;
+        game->server_ms += (long long)(game->increment - delta) * 1000;
+    }
+    long long offset = frame->received / 1000000 - game->server_ms;
+    if (game->timed == 1 || offset < game->offset_min)
+        game->offset_min = offset;
+    game->lag_ms = offset - game->offset_min;
+}
+
+// check and material for the current position
+static int
+update_status(game_t* game)
+{
+    int side    = game->pos.side;
+    game->check = pos_in_check(&game->pos, side)
+                    ? pos_king_square(&game->pos, side)
+                    : -1;
+    int material =
+      pos_material(&game->pos, WHITE) - pos_material(&game->pos, BLACK);
+    int changed    = material != game->material ? GAME_PLAYERS_CHANGED : 0;
+    game->material = material;
+    return changed;
+}
+
+int
+game_apply(game_t* game, const frame_t* frame)
+{
+    int changed = 0;
+    if (frame->type == FRAME_UNKNOWN)
+        return 0;
+
+    if (frame->type == FRAME_FEATURED && frame->has_players) {
+        memcpy(game->players, frame->players, sizeof(game->players));
+        memcpy(game->id, frame->id, sizeof(game->id));
+        game->lm[0]     = '\0';
+        game->timed     = 0;
+        game->increment = 0;
+        game->server_ms = 0;
+        game->lag_ms    = 0;
+        game->opening   = NULL;
+        changed |= GAME_PLAYERS_CHANGED;
+    }
+
+    if (update_position(game, frame) == 0) {
+        changed |= update_status(game) | GAME_BOARD_CHANGED;
+        const char* opening = book_lookup(&game->pos);
+        if (opening != NULL && opening != game->opening) {
+            game->opening = opening;
+            changed |= GAME_PLAYERS_CHANGED;
+        }
+    }
+
+    if (frame->type == FRAME_FEN) {
+        update_lag(game, frame);
+        memcpy(game->lm, frame->lm, sizeof(game->lm));
+        game->wc = frame->wc;
+        game->bc = frame->bc;
+    }
+    return changed;
+}
+
+/* Fills view with the game as it stood back plies ago, or as far back
+ * as its history goes, and returns how far back that is. The view
+ * shares the game's history and is only good until the next apply.
+ */
+size_t
+game_view(const game_t* game, size_t back, game_t* view)
+{
+    *view        = *game;
+    size_t count = history_count(&game->history);
+    if (back > count)
+        back = count;
+    if (back == 0 ||
+        history_position(&game->history, count - back, &view->pos) != 0)
+        return 0;
+    view->back  = back;
+    view->lm[0] = '\0';
+    if (count - back > 0)
+        history_move(&game->history, count - back - 1, view->lm);
+    update_status(view);
+    return back;
+}
@@ -0,0 +1,51 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include "frame.h"
+#include "history.h"
+#include "position.h"
+
+#define GAME_BOARD_CHANGED   0x1
+#define GAME_PLAYERS_CHANGED 0x2
+#define GAME_EVAL_CHANGED    0x4
+
+typedef struct
+{
+    char id[FRAME_ID_MAX];
+    position_t pos;
+    char lm[FRAME_LM_MAX];
+    int wc;
+    int bc;
+    // king square of the side to move when it is in check, otherwise -1
+    int check;
+    // material balance from white's point of view
+    int material;
+    player_t players[2];
+    size_t resyncs;
+    // clock based estimate of how far the feed is behind the game
+    int timed;
+    int increment;
+    long long server_ms;
+    long long offset_min;
+    long long lag_ms;
+    history_t history;
+    // plies the position is behind the live game, set by game_view
+    size_t back;
+    // centipawns for white from the evaluation search, at eval_depth
+    // plies; 0 deep when there is none yet
+    int eval;
+    int eval_depth;
+    // the last book position of the game, NULL until there is one
+    const char* opening;
+} game_t;
+
+void
+game_init(game_t* game);
+
+int
+game_apply(game_t* game, const frame_t* frame);
+
+size_t
+game_view(const game_t* game, size_t back, game_t* view);
+
+#endif
@@ -1,24 +1,125 @@
 #include "gfx.h"
+#include "render.h"
+#include "eval.h"
 #include <stdlib.h>
 #include <ctype.h>
 #include <locale.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <wchar.h>
 
-static int SCREEN_HEIGHT  = 24;
-static int SCREEN_WIDTH   = 80;
-static int BOARD_OFFSET_X = 0;
-static int BOARD_OFFSET_Y = 0;
+static int SCREEN_HEIGHT = 24;
+static int SCREEN_WIDTH  = 80;
 
-void
-gfx_init()
+#define PLAYER_PANEL_WIDTH 48
+
+// move list to the right of a single board
+#define MOVES_OFFSET_X 22
+#define MOVES_ROWS     9
+#define MOVES_WIDTH    13
+
+// footprint of one board in the multi-board grid
+#define CELL_WIDTH  26
+#define CELL_HEIGHT 15
+
+// the evaluation bar left of the board, in half rows, and its text
+#define EVAL_BAR_HALVES 16
+#define EVAL_TEXT_MAX   17
+// centipawns that fill three quarters of the bar
+#define EVAL_BAR_SCALE 400
+
+typedef struct
 {
-    setlocale(LC_ALL, "");
-    initscr();
+    // top left of the board, rank coordinates included
+    int x;
+    int y;
+    int panel_width;
+    const char* label;
+    // layers that have to be repainted from scratch on the next draw
+    int invalid;
+    // what is currently on screen, so a move only repaints changed squares
+    char drawn[BOARD_SIZE];
+    // highlighted king square, -1 when nobody is in check
+    int check;
+    // what the move list shows, so a move only repaints its own rows
+    size_t moves_top;
+    size_t moves_count;
+    size_t moves_shown;
+    size_t moves_plies;
+    size_t moves_back;
+    // the evaluation on screen, -1 half rows when there is none
+    int eval_filled;
+    char eval_text[EVAL_TEXT_MAX];
+} view_t;
+
+// the kinds of square a piece can be drawn on
+#define CELL_LIGHT 0
+#define CELL_DARK  1
+#define CELL_CHECK 2
+#define CELL_KINDS 3
+
+/* Every board square is two cells, the piece and a space. The cells
+ * for each piece on each kind of square are built once at start up, so
+ * drawing is copying them into a row and handing ncurses the row.
+ */
+static const char CELL_PIECES[]    = ".PNBRQKpnbrqk";
+static const wchar_t CELL_GLYPHS[] = L" ♟♞♝♜♛♚♟♞♝♜♛♚";
+// colour pairs by piece colour, then by kind of square
+static const short CELL_PAIRS[2][CELL_KINDS] = { { 3, 4, 10 }, { 1, 2, 9 } };
+
+static cchar_t cells[sizeof(CELL_PIECES) - 1][CELL_KINDS][2];
+// index into cells for every mailbox character, empty for anything else
+static unsigned char cell_index[128];
+// a row of the evaluation bar by half rows of white: none, one, both
+static cchar_t eval_cells[3];
+
+static view_t views[GFX_MAX_BOARDS];
+static int view_count = 1;
+static SCREEN* file_screen;
+static FILE* file_input;
+static WINDOW* overlay_win;
+
+static void
+build_cells()
+{
+    for (int p = 0; CELL_PIECES[p] != '\0'; p++) {
+        cell_index[(unsigned char)CELL_PIECES[p]] = (unsigned char)p;
+        int black = p > 6;
+        for (int kind = 0; kind < CELL_KINDS; kind++) {
+            short pair       = CELL_PAIRS[black][kind];
+            wchar_t glyph[2] = { CELL_GLYPHS[p], L'\0' };
+            setcchar(&cells[p][kind][0], glyph, A_NORMAL, pair, NULL);
+            setcchar(&cells[p][kind][1], L" ", A_NORMAL, pair, NULL);
+        }
+    }
+    setcchar(&eval_cells[0], L" ", A_NORMAL, 11, NULL);
+    setcchar(&eval_cells[1], L"▄", A_NORMAL, 11, NULL);
+    setcchar(&eval_cells[2], L"█", A_NORMAL, 11, NULL);
+}
+
+static int
+setup(int boards, const char** labels)
+{
+    if (boards < 1)
+        boards = 1;
+    if (boards > GFX_MAX_BOARDS)
+        boards = GFX_MAX_BOARDS;
+    view_count = boards;
+    for (int i = 0; i < boards; i++) {
+        views[i].label       = boards > 1 && labels ? labels[i] : NULL;
+        views[i].check       = -1;
+        views[i].eval_filled = -1;
+    }
+
+    // the caller falls back to headless output
     if (has_colors() == FALSE) {
         endwin();
-        printf("Your terminal does not support color\n");
-        exit(1);
+        return -1;
     }
     keypad(stdscr, TRUE);
+    cbreak();
+    nodelay(stdscr, TRUE);
     noecho();
     curs_set(false);
     use_default_colors();
@@ -45,94 +146,561 @@ gfx_init()
     init_pair(7, COLOR_BLACK, -1);
     // icon white
     init_pair(8, COLOR_WHITE, -1);
+    // black king / in check
+    init_pair(9, COLOR_BLACK, COLOR_RED);
+    // white king / in check
+    init_pair(10, COLOR_WHITE, COLOR_RED);
+    // evaluation bar, white's share from the bottom
+    init_pair(11, COLOR_WHITE, COLOR_BLACK);
+
+    build_cells();
+    gfx_reset();
+    refresh();
+    return 0;
+}
+
+int
+gfx_init(int boards, const char** labels)
+{
+    setlocale(LC_ALL, "");
+    if (initscr() == NULL)
+        return -1;
+    return setup(boards, labels);
+}
+
+/* Draws to out as if it were an xterm of the default size, with no
+ * input. Used to measure rendering without a real terminal.
+ */
+int
+gfx_init_file(int boards, const char** labels, FILE* out)
+{
+    setlocale(LC_ALL, "");
+    file_input = fopen("/dev/null", "r");
+    if (file_input == NULL)
+        return -1;
+    file_screen = newterm("xterm-256color", out, file_input);
+    if (file_screen == NULL || setup(boards, labels) != 0) {
+        if (file_screen != NULL)
+            delscreen(file_screen);
+        file_screen = NULL;
+        fclose(file_input);
+        return -1;
+    }
+    return 0;
+}
+
+static void
+layout_single(view_t* view)
+{
+    view->x = SCREEN_WIDTH / 2 - 10;
+    view->y = SCREEN_HEIGHT / 2 - 6;
+    if (view->y < 4)
+        view->y = 4;
+    view->panel_width = PLAYER_PANEL_WIDTH;
+}
+
+static void
+layout_grid()
+{
+    int cols = SCREEN_WIDTH / CELL_WIDTH;
+    if (cols < 1)
+        cols = 1;
+    if (cols > view_count)
+        cols = view_count;
+    int rows = (view_count + cols - 1) / cols;
+    int left = (SCREEN_WIDTH - cols * CELL_WIDTH) / 2;
+    int top  = (SCREEN_HEIGHT - rows * CELL_HEIGHT) / 2;
+    if (left < 0)
+        left = 0;
+    if (top < 0)
+        top = 0;
 
+    for (int i = 0; i < view_count; i++) {
+        views[i].x           = left + (i % cols) * CELL_WIDTH + 2;
+        views[i].y           = top + (i / cols) * CELL_HEIGHT + 3;
+        views[i].panel_width = CELL_WIDTH - 2;
+    }
+}
+
+void
+gfx_reset()
+{
     getmaxyx(stdscr, SCREEN_HEIGHT, SCREEN_WIDTH);
-    BOARD_OFFSET_X = SCREEN_WIDTH / 2 - 10;
-    BOARD_OFFSET_Y = SCREEN_HEIGHT / 2 - 6;
-    if (BOARD_OFFSET_Y < 4)
-        BOARD_OFFSET_Y = 4;
+    if (view_count == 1)
+        layout_single(&views[0]);
+    else
+        layout_grid();
 
-    refresh();
+    // the only place we wipe the whole screen
+    clear();
+    gfx_invalidate(GFX_LAYER_ALL);
+}
+
+/* Takes the new size of the terminal after a SIGWINCH and lays the
+ * boards out again, with every layer marked dirty. The caller then
+ * draws every board and flushes once, so the screen is cleared and
+ * repainted in a single update.
+ */
+void
+gfx_resize()
+{
+    struct winsize size;
+    if (file_screen == NULL && ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 &&
+        size.ws_row > 0 && size.ws_col > 0)
+        resizeterm(size.ws_row, size.ws_col);
+    gfx_reset();
 }
 
 void
-gfx_draw_board(char* board)
+gfx_invalidate(int layers)
+{
+    for (int i = 0; i < view_count; i++)
+        views[i].invalid |= layers;
+}
+
+static const cchar_t*
+square_cells(const view_t* view, int index, char square)
+{
+    int kind = index == view->check ? CELL_CHECK : (index / 8 + index % 8) % 2;
+    return cells[cell_index[square & 0x7f]][kind];
+}
+
+static void
+draw_square(const view_t* view, int index, char square)
+{
+    mvadd_wchnstr(
+      index / 8 + view->y,
+      index % 8 * 2 + view->x + 2,
+      square_cells(view, index, square),
+      2
+    );
+}
+
+static void
+draw_row(const view_t* view, int row, const char* board)
+{
+    cchar_t line[16];
+    for (int col = 0; col < 8; col++) {
+        int index = row * 8 + col;
+        memcpy(
+          &line[col * 2],
+          square_cells(view, index, board[index]),
+          2 * sizeof(cchar_t)
+        );
+    }
+    mvadd_wchnstr(row + view->y, view->x + 2, line, 16);
+}
+
+static void
+draw_chrome(const view_t* view)
 {
     attrset(COLOR_PAIR(5));
     for (int i = 0; i < 8; i++) {
-        mvprintw(i + BOARD_OFFSET_Y, BOARD_OFFSET_X, "%d", 8 - i);
-        mvprintw(8 + BOARD_OFFSET_Y, i * 2 + BOARD_OFFSET_X + 2, "%c", 'a' + i);
-    }
-
-    for (int row = 0; row < 8; row++) {
-        for (int col = 0; col < 8; col++) {
-            int index = row * 8 + col;
-            int white_cell =
-              row % 2 == 0 ? (col % 2 == 0 ? 1 : 0) : (col % 2 == 0 ? 0 : 1);
-            char* piece = "  ";
-            if (islower(board[index])) {
-                // black piece
-                attrset(COLOR_PAIR(white_cell ? 1 : 2));
-            } else {
-                // white piece
-                attrset(COLOR_PAIR(white_cell ? 3 : 4));
-            }
-            switch (board[index]) {
-                case 'p':
-                case 'P':
-                    piece = "♟";
-                    break;
-                case 'n':
-                case 'N':
-                    piece = "♞";
-                    break;
-                case 'b':
-                case 'B':
-                    piece = "♝";
-                    break;
-                case 'r':
-                case 'R':
-                    piece = "♜";
-                    break;
-                case 'q':
-                case 'Q':
-                    piece = "♛";
-                    break;
-                case 'k':
-                case 'K':
-                    piece = "♚";
-                    break;
-            }
-            mvprintw(
-              row + BOARD_OFFSET_Y, col * 2 + BOARD_OFFSET_X + 2, "%s ", piece
+        mvaddch(i + view->y, view->x, (chtype)('8' - i));
+        mvaddch(8 + view->y, i * 2 + view->x + 2, (chtype)('a' + i));
+    }
+    if (view->label != NULL) {
+        attrset(COLOR_PAIR(6));
+        mvaddnstr(view->y - 3, view->x, view->label, view->panel_width);
+    }
+}
+
+static void
+draw_full_board(const view_t* view, const char* board)
+{
+    for (int row = 0; row < 8; row++)
+        draw_row(view, row, board);
+}
+
+/* Predict the board after a plain move from the last drawn one. When
+ * the new board matches, only the two squares of the move need to be
+ * painted. Castling, en passant and skipped frames don't match and go
+ * through the full diff instead.
+ */
+static int
+draw_last_move(view_t* view, const char* board, const char* lm)
+{
+    int from = pos_square_index(lm);
+    int to   = from < 0 ? -1 : pos_square_index(lm + 2);
+    if (to < 0)
+        return 0;
+
+    char expected[BOARD_SIZE];
+    memcpy(expected, view->drawn, BOARD_SIZE);
+    expected[to]   = expected[from];
+    expected[from] = '.';
+    if (lm[4] != '\0')
+        expected[to] = isupper(expected[to]) ? toupper(lm[4]) : lm[4];
+    if (memcmp(expected, board, BOARD_SIZE) != 0)
+        return 0;
+
+    if (view->drawn[from] != board[from])
+        draw_square(view, from, board[from]);
+    if (view->drawn[to] != board[to])
+        draw_square(view, to, board[to]);
+    view->drawn[from] = board[from];
+    view->drawn[to]   = board[to];
+    return 1;
+}
+
+static void
+draw_board(view_t* view, const char* board, const char* lm, int check)
+{
+    int old_check = view->check;
+    view->check   = check;
+
+    if (view->invalid & GFX_LAYER_CHROME) {
+        draw_chrome(view);
+        view->invalid &= ~GFX_LAYER_CHROME;
+    }
+
+    if (view->invalid & GFX_LAYER_BOARD) {
+        draw_full_board(view, board);
+        memcpy(view->drawn, board, BOARD_SIZE);
+        view->invalid &= ~GFX_LAYER_BOARD;
+        return;
+    }
+
+    // anything else repaints the rows that differ, one call per row
+    if (lm == NULL || lm[0] == '\0' || !draw_last_move(view, board, lm)) {
+        for (int row = 0; row < 8; row++) {
+            if (memcmp(view->drawn + row * 8, board + row * 8, 8) != 0)
+                draw_row(view, row, board);
+        }
+        memcpy(view->drawn, board, BOARD_SIZE);
+    }
+
+    if (old_check != check) {
+        if (old_check >= 0)
+            draw_square(view, old_check, board[old_check]);
+        if (check >= 0)
+            draw_square(view, check, board[check]);
+    }
+}
+
+static int
+put_text(int y, int x, int end, int pair, const char* text)
+{
+    if (x >= end)
+        return x;
+    attrset(COLOR_PAIR(pair));
+    mvaddnstr(y, x, text, end - x);
+    int len = (int)strlen(text);
+    return x + len < end ? x + len : end;
+}
+
+static void
+draw_player(const view_t* view, int y, const player_t* player, int ahead)
+{
+    int end = view->x + view->panel_width;
+
+    // wipe whatever the previous game left on this line
+    attrset(A_NORMAL);
+    mvhline(y, view->x, ' ', view->panel_width);
+
+    attrset(COLOR_PAIR(player->is_black ? 7 : 8));
+    mvaddstr(y, view->x, "●");
+    int x = view->x + 2;
+    if (player->title[0] != '\0') {
+        x = put_text(y, x, end, 5, player->title);
+        x = put_text(y, x, end, 5, " ");
+    }
+    x = put_text(y, x, end, 6, player->name);
+    x = put_text(y, x, end, 5, " ");
+    x = put_text(y, x, end, 5, player->rating);
+    if (ahead > 0) {
+        char material[16];
+        snprintf(material, sizeof(material), " +%d", ahead);
+        put_text(y, x, end, 6, material);
+    }
+}
+
+static void
+draw_player_info(view_t* view, const game_t* game)
+{
+    draw_player(view, view->y - 2, &game->players[1], -game->material);
+    draw_player(view, view->y + 10, &game->players[0], game->material);
+    attrset(A_NORMAL);
+    mvhline(view->y + 11, view->x, ' ', view->panel_width);
+    if (game->opening != NULL) {
+        int end = view->x + view->panel_width;
+        put_text(view->y + 11, view->x + 2, end, 5, game->opening);
+    }
+    view->invalid &= ~GFX_LAYER_PLAYERS;
+}
+
+// the list row of a ply, counting plies from 1
+static size_t
+moves_row(size_t ply, size_t skip)
+{
+    return ply > 0 ? (ply + skip - 1) / 2 : 0;
+}
+
+static void
+draw_moves_row(int y, int x, const game_t* game, size_t row, size_t shown)
+{
+    const history_t* history = &game->history;
+    size_t skip              = history->start.side == BLACK;
+    attrset(A_NORMAL);
+    mvhline(y, x, ' ', MOVES_WIDTH);
+    for (size_t col = 0; col < 2; col++) {
+        size_t cell = row * 2 + col;
+        char uci[6];
+        if (cell < skip || history_move(history, cell - skip, uci) != 0)
+            continue;
+        size_t ply = cell - skip + 1;
+        attrset(ply == shown ? COLOR_PAIR(6) | A_REVERSE : COLOR_PAIR(5));
+        mvaddstr(y, x + (int)col * 7, uci);
+    }
+}
+
+/* Moves of the game in two columns, white and black, with the move
+ * that led to the position on the board marked. The list turns a page
+ * when that move goes past the last row, rather than scrolling a row
+ * every move, and only the rows that changed are repainted. The
+ * history does not know move numbers, so there are none.
+ */
+static void
+draw_moves(view_t* view, const game_t* game, int full)
+{
+    int x = view->x + MOVES_OFFSET_X;
+    if (x + MOVES_WIDTH > SCREEN_WIDTH)
+        return;
+    const history_t* history = &game->history;
+    size_t count             = history_count(history);
+    size_t shown             = count - game->back;
+    // black to move at the start leaves the first white cell empty
+    size_t skip = history->start.side == BLACK;
+    size_t row  = moves_row(shown, skip);
+    size_t top  = view->moves_top;
+    if (row < top)
+        top = row >= MOVES_ROWS - 1 ? row - (MOVES_ROWS - 1) : 0;
+    else if (row >= top + MOVES_ROWS)
+        top = row;
+
+    // anything but moves added to the same game repaints it all
+    if (top != view->moves_top || count < view->moves_count ||
+        history->plies - view->moves_plies != count - view->moves_count)
+        full = 1;
+    size_t first = top, last = top + MOVES_ROWS - 1;
+    if (!full) {
+        size_t lo = view->moves_shown < shown ? view->moves_shown : shown;
+        size_t hi = view->moves_shown > shown ? view->moves_shown : shown;
+        if (view->moves_count + 1 < lo)
+            lo = view->moves_count + 1;
+        if (count > hi)
+            hi = count;
+        if (moves_row(lo, skip) > first)
+            first = moves_row(lo, skip);
+        if (moves_row(hi, skip) < last)
+            last = moves_row(hi, skip);
+    }
+    for (size_t r = first; r <= last; r++)
+        draw_moves_row(view->y + (int)(r - top), x, game, r, shown);
+
+    if (full || game->back != view->moves_back) {
+        attrset(COLOR_PAIR(6));
+        mvhline(view->y - 1, x, ' ', MOVES_WIDTH);
+        if (game->back > 0)
+            mvprintw(view->y - 1, x, "-%zu", game->back);
+    }
+    view->moves_top   = top;
+    view->moves_count = count;
+    view->moves_shown = shown;
+    view->moves_plies = history->plies;
+    view->moves_back  = game->back;
+}
+
+/* A bar left of the rank numbers that white fills from the bottom as
+ * the evaluation goes its way, half full when level and all or nothing
+ * for a mate, with the score and depth under the board. Nothing is
+ * shown until the first result for the board.
+ */
+static void
+draw_eval(view_t* view, const game_t* game)
+{
+    int filled = -1;
+    char text[EVAL_TEXT_MAX] = "";
+    if (game->eval_depth > 0) {
+        int cp   = game->eval;
+        int mate = eval_mate(cp);
+        if (mate != 0) {
+            filled = mate > 0 ? EVAL_BAR_HALVES : 0;
+            snprintf(text, sizeof(text), "#%d d%d", mate, game->eval_depth);
+        } else {
+            filled = EVAL_BAR_HALVES / 2 +
+                     EVAL_BAR_HALVES / 2 * cp /
+                       ((cp < 0 ? -cp : cp) + EVAL_BAR_SCALE);
+            snprintf(
+              text,
+              sizeof(text),
+              "%+.2f d%d",
+              cp / 100.0,
+              game->eval_depth
             );
         }
-        mvprintw(row + BOARD_OFFSET_Y, 8 * 2 + BOARD_OFFSET_X + 2, "\n");
     }
+    if (!(view->invalid & GFX_LAYER_EVAL) && filled == view->eval_filled &&
+        strcmp(text, view->eval_text) == 0)
+        return;
+    view->invalid &= ~GFX_LAYER_EVAL;
+    view->eval_filled = filled;
+    memcpy(view->eval_text, text, sizeof(text));
+
+    int x = view->x - 2;
+    attrset(A_NORMAL);
+    for (int row = 0; x >= 0 && row < 8; row++) {
+        if (filled < 0) {
+            mvaddch(view->y + row, x, ' ');
+            continue;
+        }
+        // the bar's half rows that reach into this row
+        int halves = filled - (7 - row) * 2;
+        halves     = halves < 0 ? 0 : halves > 2 ? 2 : halves;
+        mvadd_wch(view->y + row, x, &eval_cells[halves]);
+    }
+    x = view->x + 2;
+    attrset(A_NORMAL);
+    mvhline(view->y + 9, x, ' ', EVAL_TEXT_MAX - 1);
+    put_text(view->y + 9, x, x + EVAL_TEXT_MAX - 1, 6, text);
 }
 
 void
-gfx_draw_player_info(player_t** players)
+gfx_draw(int board, const game_t* game, int changed)
 {
-    player_t* player_b = players[1];
-    attrset(COLOR_PAIR(7));
-    mvprintw(BOARD_OFFSET_Y - 2, BOARD_OFFSET_X, "●");
-    attrset(COLOR_PAIR(6));
-    mvprintw(BOARD_OFFSET_Y - 2, BOARD_OFFSET_X + 2, "%s", player_b->name);
-    attrset(COLOR_PAIR(5));
-    printw(" %s", player_b->rating);
+    if (board < 0 || board >= view_count)
+        return;
+    view_t* view = &views[board];
+    if ((changed & GAME_PLAYERS_CHANGED) ||
+        (view->invalid & GFX_LAYER_PLAYERS))
+        draw_player_info(view, game);
+    if ((changed & GAME_BOARD_CHANGED) || (view->invalid & GFX_LAYER_BOARD)) {
+        int full = view->invalid & GFX_LAYER_BOARD;
+        draw_board(view, game->pos.mailbox, game->lm, game->check);
+        if (view_count == 1)
+            draw_moves(view, game, full);
+    }
+    if ((changed & GAME_EVAL_CHANGED) || (view->invalid & GFX_LAYER_EVAL))
+        draw_eval(view, game);
+}
 
-    player_t* player_w = players[0];
-    attrset(COLOR_PAIR(8));
-    mvprintw(10 + BOARD_OFFSET_Y, BOARD_OFFSET_X, "●");
-    attrset(COLOR_PAIR(6));
-    mvprintw(10 + BOARD_OFFSET_Y, BOARD_OFFSET_X + 2, "%s", player_w->name);
-    attrset(COLOR_PAIR(5));
-    printw(" %s", player_w->rating);
+/* Shows text in a box over the top left corner, or takes the box down
+ * when text is NULL. The box lives in its own window so the boards
+ * under it keep their state and reappear as they were.
+ */
+void
+gfx_overlay(const char* text)
+{
+    if (text == NULL) {
+        if (overlay_win != NULL) {
+            delwin(overlay_win);
+            overlay_win = NULL;
+            touchwin(stdscr);
+        }
+        return;
+    }
+
+    int lines = 1, width = 0, len = 0;
+    for (const char* c = text; *c; c++) {
+        if (*c == '\n') {
+            lines++;
+            len = 0;
+        } else if (++len > width) {
+            width = len;
+        }
+    }
+    if (lines + 2 > SCREEN_HEIGHT)
+        lines = SCREEN_HEIGHT - 2;
+    if (width + 4 > SCREEN_WIDTH)
+        width = SCREEN_WIDTH - 4;
+    if (lines < 1 || width < 1)
+        return;
+
+    int height, cols;
+    if (overlay_win != NULL)
+        getmaxyx(overlay_win, height, cols);
+    if (overlay_win == NULL || height != lines + 2 || cols != width + 4) {
+        gfx_overlay(NULL);
+        overlay_win = newwin(lines + 2, width + 4, 0, 0);
+        if (overlay_win == NULL)
+            return;
+    }
+
+    werase(overlay_win);
+    wattron(overlay_win, COLOR_PAIR(6));
+    box(overlay_win, 0, 0);
+    int row = 0;
+    for (const char* line = text; row < lines; row++) {
+        const char* end = strchr(line, '\n');
+        int n           = end != NULL ? (int)(end - line) : (int)strlen(line);
+        mvwaddnstr(overlay_win, row + 1, 2, line, n < width ? n : width);
+        if (end == NULL)
+            break;
+        line = end + 1;
+    }
+    wattroff(overlay_win, COLOR_PAIR(6));
+}
+
+/* Next key from the terminal, or RENDER_NO_KEY when none is waiting.
+ * Special keys without a RENDER_KEY_* are skipped.
+ */
+int
+gfx_key()
+{
+    for (;;) {
+        int key = getch();
+        switch (key) {
+            case ERR:
+                return RENDER_NO_KEY;
+            case KEY_LEFT:
+                return RENDER_KEY_LEFT;
+            case KEY_RIGHT:
+                return RENDER_KEY_RIGHT;
+            case KEY_PPAGE:
+                return RENDER_KEY_PAGE_UP;
+            case KEY_NPAGE:
+                return RENDER_KEY_PAGE_DOWN;
+            case KEY_HOME:
+                return RENDER_KEY_HOME;
+            case KEY_END:
+                return RENDER_KEY_END;
+        }
+        if (key < KEY_MIN)
+            return key;
+    }
+}
+
+void
+gfx_flush()
+{
+    wnoutrefresh(stdscr);
+    if (overlay_win != NULL) {
+        // whatever changed on the boards may have painted over the box
+        touchwin(overlay_win);
+        wnoutrefresh(overlay_win);
+    }
+    doupdate();
 }
 
 void
 gfx_destroy()
 {
+    gfx_overlay(NULL);
     endwin();
-}
\ No newline at end of file
+    if (file_screen != NULL) {
+        delscreen(file_screen);
+        fclose(file_input);
+        file_screen = NULL;
+    }
+}
+
+const render_t render_curses = {
+    .name    = "curses",
+    .init    = gfx_init,
+    .draw    = gfx_draw,
+    .flush   = gfx_flush,
+    .overlay = gfx_overlay,
+    .key     = gfx_key,
+    .resize  = gfx_resize,
+    .destroy = gfx_destroy,
+};
@@ -2,18 +2,45 @@
 #define GFX_H
 
 #include <curses.h>
-#include "chunk.h"
+#include "frame.h"
+#include "game.h"
 
-void
-gfx_init();
+#define GFX_LAYER_CHROME  0x1
+#define GFX_LAYER_PLAYERS 0x2
+#define GFX_LAYER_BOARD   0x4
+#define GFX_LAYER_EVAL    0x8
+#define GFX_LAYER_ALL     0xf
+
+#define GFX_MAX_BOARDS 16
+
+int
+gfx_init(int boards, const char** labels);
+
+int
+gfx_init_file(int boards, const char** labels, FILE* out);
 
 void
 gfx_destroy();
 
 void
-gfx_draw_board(char* board);
+gfx_reset();
+
+void
+gfx_resize();
+
+void
+gfx_invalidate(int layers);
+
+void
+gfx_draw(int board, const game_t* game, int changed);
+
+void
+gfx_overlay(const char* text);
+
+int
+gfx_key();
 
 void
-gfx_draw_player_info(player_t** players);
+gfx_flush();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,170 @@
+/* Headless Output
+ *
+ * A render backend that writes one JSON object per line to stdout
+ * instead of driving a terminal, for dashboards and scripts:
+ *
+ *   {"board":0,"channel":"top","event":"game","id":"abcd1234",
+ *    "white":{"name":"...","title":"GM","rating":"2900"},"black":{...}}
+ *   {"board":0,"channel":"top","event":"move","lm":"e2e4",
+ *    "fen":"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b",
+ *    "wc":59,"bc":60,"check":null,"material":0,
+ *    "opening":"B00 King's Pawn Game"}
+ *   {"board":0,"channel":"top","event":"eval","score":35,"mate":null,
+ *    "depth":7}
+ *
+ * A game event is written when a board's game id changes, a move
+ * event for every board update and an eval event whenever the search
+ * has a new score for the position on the board. opening is the name
+ * of the game's last position in the opening book, or null. The score
+ * is in centipawns for white; mate is moves to mate, negative when
+ * black mates, or null. Updates are coalesced by the scheduler exactly
+ * as on the terminal, so --fps also limits the event rate. Lines are
+ * buffered by stdio and written out on flush.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "eval.h"
+#include "render.h"
+
+static int board_count;
+static const char** board_labels;
+static char shown_ids[RENDER_MAX_BOARDS][FRAME_ID_MAX];
+
+static void
+put_string(const char* s)
+{
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            printf("\\%c", c);
+        else if (c < 0x20)
+            printf("\\u%04x", c);
+        else
+            putchar(c);
+    }
+    putchar('"');
+}
+
+static void
+put_player(const char* key, const player_t* player)
+{
+    printf(",\"%s\":{\"name\":", key);
+    put_string(player->name);
+    fputs(",\"title\":", stdout);
+    put_string(player->title);
+    fputs(",\"rating\":", stdout);
+    put_string(player->rating);
+    putchar('}');
+}
+
+static void
+put_clock(const char* key, int clock)
+{
+    if (clock < 0)
+        printf(",\"%s\":null", key);
+    else
+        printf(",\"%s\":%d", key, clock);
+}
+
+static void
+put_header(int board, const char* event)
+{
+    printf("{\"board\":%d,\"channel\":", board);
+    put_string(board_labels != NULL ? board_labels[board] : "top");
+    printf(",\"event\":\"%s\"", event);
+}
+
+static int
+headless_init(int boards, const char** labels)
+{
+    board_count  = boards < RENDER_MAX_BOARDS ? boards : RENDER_MAX_BOARDS;
+    board_labels = labels;
+    memset(shown_ids, 0, sizeof(shown_ids));
+    return 0;
+}
+
+static void
+put_move(int board, const game_t* game)
+{
+    char fen[FRAME_FEN_MAX];
+    if (pos_to_fen(&game->pos, fen, sizeof(fen)) < 0)
+        return;
+    put_header(board, "move");
+    fputs(",\"lm\":", stdout);
+    put_string(game->lm);
+    fputs(",\"fen\":", stdout);
+    put_string(fen);
+    put_clock("wc", game->wc);
+    put_clock("bc", game->bc);
+    if (game->check >= 0)
+        printf(
+          ",\"check\":\"%c%c\"",
+          'a' + game->check % 8,
+          '8' - game->check / 8
+        );
+    else
+        fputs(",\"check\":null", stdout);
+    printf(",\"material\":%d,\"opening\":", game->material);
+    if (game->opening != NULL)
+        put_string(game->opening);
+    else
+        fputs("null", stdout);
+    fputs("}\n", stdout);
+}
+
+static void
+put_eval(int board, const game_t* game)
+{
+    put_header(board, "eval");
+    printf(",\"score\":%d", game->eval);
+    int mate = eval_mate(game->eval);
+    if (mate != 0)
+        printf(",\"mate\":%d", mate);
+    else
+        fputs(",\"mate\":null", stdout);
+    printf(",\"depth\":%d}\n", game->eval_depth);
+}
+
+static void
+headless_draw(int board, const game_t* game, int changed)
+{
+    if (board < 0 || board >= board_count)
+        return;
+
+    if (strcmp(shown_ids[board], game->id) != 0) {
+        memcpy(shown_ids[board], game->id, FRAME_ID_MAX);
+        put_header(board, "game");
+        fputs(",\"id\":", stdout);
+        put_string(game->id);
+        put_player("white", &game->players[0]);
+        put_player("black", &game->players[1]);
+        fputs("}\n", stdout);
+    }
+
+    if (changed & GAME_BOARD_CHANGED)
+        put_move(board, game);
+    if ((changed & GAME_EVAL_CHANGED) && game->eval_depth > 0)
+        put_eval(board, game);
+}
+
+static void
+headless_flush()
+{
+    fflush(stdout);
+}
+
+static void
+headless_destroy()
+{
+    fflush(stdout);
+}
+
+const render_t render_headless = {
+    .name    = "headless",
+    .init    = headless_init,
+    .draw    = headless_draw,
+    .flush   = headless_flush,
+    .destroy = headless_destroy,
+};
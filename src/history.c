@@ -0,0 +1,135 @@
+/* Move History
+ *
+ * Keeps the moves of every game on screen so it can be paged back
+ * through and listed beside the board. A move is stored in 16 bits,
+ * packed by pos_pack_move like the recorder does, and positions are
+ * rebuilt on demand by replaying moves from the game's start position.
+ *
+ * Moves live in fixed size chunks carved out of one static pool, so
+ * pushing a move never allocates. A game that runs past its last chunk
+ * hands the oldest chunk back, after folding its moves into the start
+ * position, and a new game returns all of its chunks at once. Memory
+ * is therefore the pool and nothing else however long games run and
+ * however many of them go by. Should the pool run dry, a game reuses
+ * its own oldest chunk and, if it has none, simply stops recording.
+ */
+
+#include "history.h"
+
+static uint16_t pool[HISTORY_POOL_CHUNKS][HISTORY_CHUNK_MOVES];
+static int16_t free_chunks[HISTORY_POOL_CHUNKS];
+static int free_count = -1;
+
+static int
+take_chunk()
+{
+    if (free_count < 0) {
+        for (int i = 0; i < HISTORY_POOL_CHUNKS; i++)
+            free_chunks[i] = (int16_t)(HISTORY_POOL_CHUNKS - 1 - i);
+        free_count = HISTORY_POOL_CHUNKS;
+    }
+    return free_count > 0 ? free_chunks[--free_count] : -1;
+}
+
+static void
+give_chunk(int chunk)
+{
+    free_chunks[free_count++] = (int16_t)chunk;
+}
+
+static uint16_t
+move_at(const history_t* history, size_t ply)
+{
+    int slot = (history->first + (int)(ply / HISTORY_CHUNK_MOVES)) %
+               HISTORY_MAX_CHUNKS;
+    return pool[history->chunks[slot]][ply % HISTORY_CHUNK_MOVES];
+}
+
+// drops the oldest chunk, keeping the moves in it in the start position
+static int
+drop_oldest(history_t* history)
+{
+    int chunk  = history->chunks[history->first];
+    size_t end = history->count < HISTORY_CHUNK_MOVES ? history->count
+                                                      : HISTORY_CHUNK_MOVES;
+    char uci[6];
+    for (size_t i = 0; i < end; i++) {
+        pos_unpack_move(pool[chunk][i], uci);
+        pos_apply_uci(&history->start, uci);
+    }
+    history->first = (history->first + 1) % HISTORY_MAX_CHUNKS;
+    history->used--;
+    history->count -= end;
+    return chunk;
+}
+
+void
+history_reset(history_t* history, const position_t* start)
+{
+    for (int i = 0; i < history->used; i++)
+        give_chunk(history->chunks[(history->first + i) % HISTORY_MAX_CHUNKS]);
+    history->start = *start;
+    history->first = 0;
+    history->used  = 0;
+    history->count = 0;
+    history->plies = 0;
+}
+
+/* Appends a move in UCI notation. Returns -1 when it cannot be packed
+ * or there was nowhere to keep it.
+ */
+int
+history_push(history_t* history, const char* uci)
+{
+    int move = pos_pack_move(uci);
+    if (move < 0)
+        return -1;
+    if (history->count == (size_t)history->used * HISTORY_CHUNK_MOVES) {
+        int chunk = history->used < HISTORY_MAX_CHUNKS ? take_chunk() : -1;
+        if (chunk < 0 && history->used > 0)
+            chunk = drop_oldest(history);
+        if (chunk < 0)
+            return -1;
+        int slot = (history->first + history->used++) % HISTORY_MAX_CHUNKS;
+        history->chunks[slot] = (int16_t)chunk;
+    }
+    int slot = (history->first + (int)(history->count / HISTORY_CHUNK_MOVES)) %
+               HISTORY_MAX_CHUNKS;
+    pool[history->chunks[slot]][history->count % HISTORY_CHUNK_MOVES] =
+      (uint16_t)move;
+    history->count++;
+    history->plies++;
+    return 0;
+}
+
+size_t
+history_count(const history_t* history)
+{
+    return history->count;
+}
+
+/* The ply-th stored move, counting from 0, in UCI notation. */
+int
+history_move(const history_t* history, size_t ply, char* uci)
+{
+    if (ply >= history->count)
+        return -1;
+    pos_unpack_move(move_at(history, ply), uci);
+    return 0;
+}
+
+/* The position after the first ply stored moves. */
+int
+history_position(const history_t* history, size_t ply, position_t* pos)
+{
+    if (ply > history->count)
+        return -1;
+    *pos = history->start;
+    char uci[6];
+    for (size_t i = 0; i < ply; i++) {
+        pos_unpack_move(move_at(history, i), uci);
+        if (pos_apply_uci(pos, uci) != 0)
+            return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "position.h"
+
+#define HISTORY_CHUNK_MOVES 64
+// per game, so a game keeps its last 1024 plies
+#define HISTORY_MAX_CHUNKS  16
+#define HISTORY_POOL_CHUNKS 256
+
+/* The moves of one game since start, 16 bits each, in chunks taken from
+ * a shared pool. chunks is a ring of pool indices starting at first.
+ * plies counts every move pushed since history_reset, including those
+ * dropped from the front once the game outgrew its chunks.
+ */
+typedef struct
+{
+    position_t start;
+    int16_t chunks[HISTORY_MAX_CHUNKS];
+    int first;
+    int used;
+    size_t count;
+    size_t plies;
+} history_t;
+
+void
+history_reset(history_t* history, const position_t* start);
+
+int
+history_push(history_t* history, const char* uci);
+
+size_t
+history_count(const history_t* history);
+
+int
+history_move(const history_t* history, size_t ply, char* uci);
+
+int
+history_position(const history_t* history, size_t ply, position_t* pos);
+
+#endif
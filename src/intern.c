@@ -0,0 +1,119 @@
+/* Interning
+ *
+ * The same few hundred players are on TV all day, so the recorder
+ * gives each one an id the first time it appears and refers to it by
+ * id after that, in recordings and in the stream sent to clients.
+ *
+ * Lookups go through an open addressing table with linear probing,
+ * at most half full, and the strings are copied into an arena so an
+ * entry costs no allocation of its own. There is no removal: when all
+ * INTERN_MAX ids are taken the table is cleared and numbering starts
+ * over, which the record format allows for by letting ids be defined
+ * again.
+ */
+
+#include "intern.h"
+#include <string.h>
+
+static uint32_t
+hash_player(const char* name, const char* title)
+{
+    // FNV-1a over both strings and a separator
+    uint32_t hash = 2166136261u;
+    for (const char* c = name; *c; c++)
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    hash = (hash ^ 0xff) * 16777619u;
+    for (const char* c = title; *c; c++)
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    return hash;
+}
+
+static char*
+keep(intern_t* table, const char* s)
+{
+    size_t len = strlen(s) + 1;
+    char* copy = arena_alloc(&table->arena, len);
+    if (copy != NULL)
+        memcpy(copy, s, len);
+    return copy;
+}
+
+void
+intern_init(intern_t* table)
+{
+    memset(table->slots, 0, sizeof(table->slots));
+    table->count = 0;
+    arena_init(&table->arena);
+}
+
+// the slot holding the player, or the empty slot where it would go
+static int
+probe(const intern_t* table, const char* name, const char* title, uint32_t h)
+{
+    int slot = (int)(h & (INTERN_SLOTS - 1));
+    for (;;) {
+        int id = table->slots[slot];
+        if (id == 0)
+            return slot;
+        const intern_entry_t* e = &table->entries[id];
+        if (e->hash == h && !strcmp(e->name, name) && !strcmp(e->title, title))
+            return slot;
+        slot = (slot + 1) & (INTERN_SLOTS - 1);
+    }
+}
+
+/* The player's id, or 0 when it has none. */
+int
+intern_find(const intern_t* table, const char* name, const char* title)
+{
+    uint32_t hash = hash_player(name, title);
+    return table->slots[probe(table, name, title, hash)];
+}
+
+/* The player's id, giving it the next one if it is new. added is set
+ * when it was. Returns 0 when out of memory.
+ */
+int
+intern_add(intern_t* table, const char* name, const char* title, int* added)
+{
+    uint32_t hash = hash_player(name, title);
+    int slot      = probe(table, name, title, hash);
+    *added        = 0;
+    if (table->slots[slot] != 0)
+        return table->slots[slot];
+
+    if (table->count == INTERN_MAX) {
+        intern_clear(table);
+        slot = probe(table, name, title, hash);
+    }
+    intern_entry_t* e = &table->entries[table->count + 1];
+    e->name           = keep(table, name);
+    e->title          = keep(table, title);
+    e->hash           = hash;
+    if (e->name == NULL || e->title == NULL)
+        return 0;
+    table->slots[slot] = (int16_t)++table->count;
+    *added             = 1;
+    return table->count;
+}
+
+const intern_entry_t*
+intern_get(const intern_t* table, int id)
+{
+    return id > 0 && id <= table->count ? &table->entries[id] : NULL;
+}
+
+void
+intern_clear(intern_t* table)
+{
+    memset(table->slots, 0, sizeof(table->slots));
+    table->count = 0;
+    arena_reset(&table->arena);
+}
+
+void
+intern_destroy(intern_t* table)
+{
+    arena_destroy(&table->arena);
+    table->count = 0;
+}
@@ -0,0 +1,46 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdint.h>
+#include "arena.h"
+
+#define INTERN_MAX   1024
+#define INTERN_SLOTS 2048
+
+typedef struct
+{
+    const char* name;
+    const char* title;
+    uint32_t hash;
+} intern_entry_t;
+
+/* Players by name and title, each stored once and numbered from 1 in
+ * the order they were first seen.
+ */
+typedef struct
+{
+    int16_t slots[INTERN_SLOTS];
+    intern_entry_t entries[INTERN_MAX + 1];
+    int count;
+    arena_t arena;
+} intern_t;
+
+void
+intern_init(intern_t* table);
+
+int
+intern_find(const intern_t* table, const char* name, const char* title);
+
+int
+intern_add(intern_t* table, const char* name, const char* title, int* added);
+
+const intern_entry_t*
+intern_get(const intern_t* table, int id);
+
+void
+intern_clear(intern_t* table);
+
+void
+intern_destroy(intern_t* table);
+
+#endif
@@ -1,31 +1,815 @@
+#define _GNU_SOURCE
 #include <stdio.h>
-#include "gfx.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "render.h"
 #include "feed.h"
-#include "chunk.h"
-#include "fen.h"
+#include "decode.h"
+#include "game.h"
+#include "queue.h"
+#include "sched.h"
+#include "stats.h"
+#include "memstat.h"
+#include "record.h"
+#include "replay.h"
+#include "serve.h"
+#include "client.h"
+#include "eval.h"
+#include "book.h"
 #include "lib/debug.h"
 
+// the build points this at the book it compiles from eco/eco.tsv
+#ifndef LITV_BOOK
+#define LITV_BOOK "eco.book"
+#endif
+
+#define SOAK_REPORT_FRAMES 100
+#define OVERLAY_REFRESH_MS 250
+#define STATS_DUMP_MS      10000
+#define NS_PER_MS          1000000LL
+#define LATENCY_MAX        1024
+#define SCROLL_PAGE        16
+#define SCROLL_ALL         (HISTORY_MAX_CHUNKS * HISTORY_CHUNK_MOVES)
+
+static game_t games[FEED_MAX_CHANNELS];
+static int pending[FEED_MAX_CHANNELS];
+// plies each board is scrolled back from the live position
+static size_t back[FEED_MAX_CHANNELS];
+static const char* channels[FEED_MAX_CHANNELS];
+static int channel_count;
+static queue_t queue;
+static sched_t sched;
+static int max_fps = SCHED_DEFAULT_FPS;
+static int eval_workers = EVAL_DEFAULT_WORKERS;
+static const char* book_path;
+static int soak_mode;
+static int headless_mode;
+// NULL in soak mode
+static const render_t* render;
+static size_t soak_frames;
+static size_t soak_window_allocs;
+static recorder_t recorder;
+static const char* record_path;
+static replay_t replay;
+static const char* replay_path;
+static double replay_speed = 1.0;
+static size_t replay_game;
+static const char* serve_addr;
+static const char* connect_addr;
+static record_index_t server_index;
+static int overlay_visible;
+static long long overlay_due;
+static FILE* stats_file;
+static long long dump_due;
+// the signal handler writes the signal number, the render loop reads
+static int signal_pipe[2] = { -1, -1 };
+static int quitting;
+// every board stays on its move while paused
+static int paused;
+// frames applied since the last flush, to time them to the screen
+static long long unflushed[LATENCY_MAX][2];
+static size_t unflushed_count;
+
+static void
+soak_report()
+{
+    size_t allocs = memstat_allocs();
+    printf(
+      "frames %zu allocs %zu frees %zu fallbacks %zu allocs/frame %.3f\n",
+      soak_frames,
+      allocs,
+      memstat_frees(),
+      decode_fallbacks(),
+      (double)(allocs - soak_window_allocs) / SOAK_REPORT_FRAMES
+    );
+    fflush(stdout);
+    soak_window_allocs = allocs;
+}
+
+void
+on_frame(frame_t* frame)
+{
+    // replayed frames start their clock here
+    if (frame->received == 0)
+        frame->received = frame->decoded = stats_now();
+    if (record_path != NULL)
+        record_frame(&recorder, frame);
+    if (serve_addr != NULL)
+        serve_frame(frame);
+    // a replay shows every move; a socket must never wait on the screen
+    if (replay_path != NULL)
+        queue_push_wait(&queue, frame);
+    else
+        queue_push(&queue, frame);
+}
+
+/* Network thread: decode every line from the feed and hand it to the
+ * render thread. Nothing here touches the terminal, so a slow screen
+ * never holds up the socket.
+ */
+void
+on_data(int channel, char* chunk, size_t len)
+{
+    frame_t frame;
+    long long start = stats_now();
+    int r           = decode_frame(chunk, len, &frame);
+    frame.decoded   = stats_now();
+    stats_time(STATS_DECODE, frame.decoded - start);
+    if (r != 0 || frame.type == FRAME_UNKNOWN)
+        return;
+    frame.channel  = channel;
+    frame.received = feed_received_at();
+    on_frame(&frame);
+}
+
 void
-on_data(char* chunk, size_t len)
+on_batch()
+{
+    if (record_path != NULL)
+        record_tick(&recorder);
+    if (serve_addr != NULL)
+        serve_batch();
+    queue_notify(&queue);
+}
+
+/* Runs from the start of main, so the connection is being set up while
+ * the terminal is; curl and TLS are only initialised here, and only
+ * for the live feed.
+ */
+static void*
+network_main(void* arg)
+{
+    if (replay_path != NULL)
+        replay_run(&replay, replay_game, replay_speed, on_frame, on_batch);
+    else if (connect_addr != NULL)
+        client_run(on_frame, on_batch);
+    else {
+        memstat_hook_curl();
+        feed_init(channels, channel_count, on_data, on_batch);
+    }
+    queue_close(&queue);
+    return NULL;
+}
+
+static void
+on_signal(int sig)
+{
+    int saved       = errno;
+    unsigned char c = (unsigned char)sig;
+    // a full pipe already has the render loop's attention
+    ssize_t n = write(signal_pipe[1], &c, 1);
+    (void)n;
+    errno = saved;
+}
+
+/* Turns SIGINT, SIGTERM and, with a terminal, SIGWINCH into bytes on
+ * signal_pipe, so the render loop sees them in the same poll as frames
+ * and keys: a resize lays the screen out again once, between draws,
+ * and an interrupt quits as cleanly as the q key.
+ */
+static void
+watch_signals()
 {
-    chunk_parse(chunk, len);
-    if (!chunk_is_move_description()) {
-        clear();
-        player_t** players = chunk_get_players();
-        gfx_draw_player_info(players);
+    if (pipe2(signal_pipe, O_NONBLOCK | O_CLOEXEC) != 0)
+        return;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    action.sa_flags   = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    if (render != NULL && render->resize != NULL)
+        sigaction(SIGWINCH, &action, NULL);
+}
+
+/* The terminal unless asked otherwise, stdout is not a terminal, or
+ * the terminal cannot show colour; then JSON lines on stdout.
+ */
+static void
+open_render()
+{
+    if (!headless_mode && isatty(STDOUT_FILENO)) {
+        render = &render_curses;
+        if (render->init(channel_count, channels) == 0)
+            return;
+        fprintf(stderr, "no colour support, writing events to stdout\n");
+    }
+    render = &render_headless;
+    render->init(channel_count, channels);
+}
+
+static int
+open_replay()
+{
+    if (replay_open(&replay, replay_path) != 0) {
+        fprintf(stderr, "%s: not a readable recording\n", replay_path);
+        return -1;
+    }
+    if (replay_game > replay.index.count) {
+        fprintf(
+          stderr,
+          "%s: no game %zu, the recording has %zu\n",
+          replay_path,
+          replay_game,
+          replay.index.count
+        );
+        replay_close(&replay);
+        return -1;
     }
-    char* fen   = (char*)chunk_get_fen();
-    char* board = fen_to_board(fen);
-    gfx_draw_board(board);
-    refresh();
-    chunk_destroy();
+    channel_count = replay.index.channels;
+    for (int i = 0; i < channel_count; i++)
+        channels[i] = replay.index.names[i];
+    return 0;
+}
+
+static int
+open_client()
+{
+    if (client_open(connect_addr, &server_index) != 0) {
+        fprintf(stderr, "%s: no litv server there\n", connect_addr);
+        return -1;
+    }
+    channel_count = server_index.channels;
+    for (int i = 0; i < channel_count; i++)
+        channels[i] = server_index.names[i];
+    return 0;
+}
+
+static void
+flush_screen()
+{
+    size_t written  = stats_thread_written();
+    long long start = stats_now();
+    render->flush();
+    long long now = stats_now();
+    stats_time(STATS_FLUSH, now - start);
+    stats_add(STATS_BYTES_OUT, stats_thread_written() - written);
+
+    for (size_t i = 0; i < unflushed_count; i++) {
+        stats_time(STATS_LATENCY, now - unflushed[i][0]);
+        stats_time(STATS_DISPLAY, now - unflushed[i][1]);
+    }
+    unflushed_count = 0;
+}
+
+static void
+apply(const frame_t* frame)
+{
+    game_t* game    = &games[frame->channel];
+    size_t plies    = game->history.plies;
+    long long start = stats_now();
+    int changed     = game_apply(game, frame);
+    stats_time(STATS_POSITION, stats_now() - start);
+
+    // a scrolled back board stays on its move until the game changes
+    size_t* behind = &back[frame->channel];
+    if ((*behind > 0 || paused) && game->history.plies == plies + 1)
+        (*behind)++;
+    else if (game->history.plies != plies)
+        *behind = 0;
+    pending[frame->channel] |= changed;
+    sched_mark(&sched, changed);
+
+    if (frame->type == FRAME_FEN && game->timed > 1)
+        stats_time(STATS_FEED_LAG, game->lag_ms * NS_PER_MS);
+    if (changed && unflushed_count < LATENCY_MAX) {
+        unflushed[unflushed_count][0]   = frame->received;
+        unflushed[unflushed_count++][1] = frame->decoded;
+    }
+}
+
+// draws the board, and has whatever is on it evaluated
+static void
+draw(int channel, int changed)
+{
+    static game_t view;
+    const game_t* shown = &games[channel];
+    if (back[channel] > 0 &&
+        game_view(&games[channel], back[channel], &view) > 0)
+        shown = &view;
+    eval_submit(channel, &shown->pos);
+    render->draw(channel, shown, changed);
+}
+
+static void
+take_evals()
+{
+    eval_ack();
+    for (int i = 0; i < channel_count; i++) {
+        game_t* game = &games[i];
+        if (eval_take(i, &game->eval, &game->eval_depth)) {
+            pending[i] |= GAME_EVAL_CHANGED;
+            sched_redraw(&sched, GAME_EVAL_CHANGED);
+        }
+    }
+}
+
+// moves every board delta plies into its history, positive is back
+static void
+scroll_boards(long delta)
+{
+    for (int i = 0; i < channel_count; i++) {
+        long count  = (long)history_count(&games[i].history);
+        long target = (long)back[i] + delta;
+        if (target > count)
+            target = count;
+        back[i] = target > 0 ? (size_t)target : 0;
+        draw(i, GAME_BOARD_CHANGED | GAME_PLAYERS_CHANGED);
+    }
+    flush_screen();
+}
+
+/* Stops the source of frames. The render loop goes on until the
+ * network thread has delivered its last batch and closed the queue, so
+ * everything received is drawn, recorded and served before exit.
+ */
+static void
+quit()
+{
+    if (quitting)
+        return;
+    quitting = 1;
+    if (replay_path != NULL)
+        replay_stop(&replay);
+    else if (connect_addr != NULL)
+        client_stop();
+    else
+        feed_stop();
+}
+
+static void
+read_keys()
+{
+    int key;
+    while ((key = render->key()) != RENDER_NO_KEY) {
+        switch (key) {
+            case RENDER_KEY_LEFT:
+                scroll_boards(1);
+                break;
+            case RENDER_KEY_RIGHT:
+                scroll_boards(-1);
+                break;
+            case RENDER_KEY_PAGE_UP:
+                scroll_boards(SCROLL_PAGE);
+                break;
+            case RENDER_KEY_PAGE_DOWN:
+                scroll_boards(-SCROLL_PAGE);
+                break;
+            case RENDER_KEY_HOME:
+                scroll_boards(SCROLL_ALL);
+                break;
+            case RENDER_KEY_END:
+                scroll_boards(-SCROLL_ALL);
+                break;
+            case 'p':
+                paused = !paused;
+                if (!paused)
+                    scroll_boards(-SCROLL_ALL);
+                break;
+            case 'q':
+                quit();
+                break;
+            case 's':
+                overlay_visible = !overlay_visible;
+                overlay_due     = 0;
+                if (!overlay_visible) {
+                    render->overlay(NULL);
+                    flush_screen();
+                }
+                break;
+        }
+    }
+}
+
+static void
+draw_all()
+{
+    for (int i = 0; i < channel_count; i++) {
+        draw(i, GAME_BOARD_CHANGED | GAME_PLAYERS_CHANGED);
+        pending[i] = 0;
+    }
+    overlay_due = 0;
+    flush_screen();
+}
+
+// lays the screen out for its new size and repaints every board
+static void
+resize_screen()
+{
+    render->resize();
+    draw_all();
+}
+
+static void
+read_signals()
+{
+    unsigned char sigs[64];
+    ssize_t n;
+    int resized = 0;
+    while ((n = read(signal_pipe[0], sigs, sizeof(sigs))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            if (sigs[i] == SIGWINCH)
+                resized = 1;
+            else
+                quit();
+        }
+    }
+    if (resized && render != NULL && render->resize != NULL)
+        resize_screen();
+}
+
+/* Refreshes the stats overlay and writes the stats file when they are
+ * due. Returns the milliseconds until the next of them, or -1.
+ */
+static int
+periodic()
+{
+    long long now  = stats_now();
+    long long next = -1;
+    if (overlay_visible) {
+        if (now >= overlay_due) {
+            char text[STATS_OVERLAY_MAX];
+            stats_format(text, sizeof(text));
+            render->overlay(text);
+            flush_screen();
+            overlay_due = now + OVERLAY_REFRESH_MS * NS_PER_MS;
+        }
+        next = overlay_due;
+    }
+    if (stats_file != NULL) {
+        if (now >= dump_due) {
+            stats_dump(stats_file);
+            dump_due = now + STATS_DUMP_MS * NS_PER_MS;
+        }
+        if (next < 0 || dump_due < next)
+            next = dump_due;
+    }
+    return next < 0 ? -1 : (int)((next - now + NS_PER_MS - 1) / NS_PER_MS);
+}
+
+static int
+wait_ms(int a, int b)
+{
+    if (a < 0)
+        return b;
+    if (b < 0)
+        return a;
+    return a < b ? a : b;
+}
+
+/* Render thread: apply everything that is queued and let the scheduler
+ * decide when to draw. When several moves arrive within one tick only
+ * the latest position reaches the screen. Keys are read on the same
+ * thread, between frames.
+ */
+static void
+render_loop()
+{
+    // poll skips a negative fd
+    int input = render != NULL && render->key != NULL ? STDIN_FILENO : -1;
+    struct pollfd pfds[4] = {
+        { queue_fd(&queue), POLLIN, 0 },
+        { input, POLLIN, 0 },
+        { signal_pipe[0], POLLIN, 0 },
+        { eval_fd(), POLLIN, 0 },
+    };
+    sched_init(&sched, max_fps);
+    for (;;) {
+        int closed = queue_is_closed(&queue);
+        frame_t frame;
+        while (queue_pop(&queue, &frame)) {
+            apply(&frame);
+            if (soak_mode && ++soak_frames % SOAK_REPORT_FRAMES == 0)
+                soak_report();
+        }
+
+        // whatever is left goes out before we stop
+        if (sched_take(&sched, closed) && render != NULL) {
+            for (int i = 0; i < channel_count; i++) {
+                if (pending[i])
+                    draw(i, pending[i]);
+                pending[i] = 0;
+            }
+            flush_screen();
+        }
+
+        int timeout = wait_ms(sched_timeout(&sched), periodic());
+        if (closed)
+            break;
+        if (poll(pfds, 4, timeout) > 0) {
+            if (pfds[0].revents)
+                queue_ack(&queue);
+            if (pfds[1].revents)
+                read_keys();
+            if (pfds[2].revents)
+                read_signals();
+            if (pfds[3].revents)
+                take_evals();
+        }
+    }
+}
+
+/* Blocks until a key is pressed, a signal asks to quit or the input
+ * goes away. Readable input with nothing in it is the end of a file.
+ */
+static void
+wait_key()
+{
+    struct pollfd pfds[2] = {
+        { STDIN_FILENO, POLLIN, 0 },
+        { signal_pipe[0], POLLIN, 0 },
+    };
+    while (!quitting) {
+        if (poll(pfds, 2, -1) < 0)
+            continue;
+        if (pfds[1].revents)
+            read_signals();
+        if (pfds[0].revents & (POLLHUP | POLLERR | POLLNVAL))
+            return;
+        int waiting = 0;
+        if ((pfds[0].revents & POLLIN) &&
+            (render->key() != RENDER_NO_KEY ||
+             ioctl(STDIN_FILENO, FIONREAD, &waiting) != 0 || waiting == 0))
+            return;
+    }
+}
+
+static void
+print_stats()
+{
+    fprintf(
+      stderr,
+      "frames received %zu, drawn %zu, dropped %zu, reconnects %zu\n",
+      sched.received,
+      sched.drawn,
+      atomic_load(&queue.stalls),
+      connect_addr != NULL ? client_reconnects() : feed_reconnects()
+    );
+    if (stats_count(STATS_LATENCY) > 0)
+        fprintf(
+          stderr,
+          "move to screen latency p50 %.1f ms, p99 %.1f ms\n",
+          stats_percentile(STATS_LATENCY, 0.50) / 1e6,
+          stats_percentile(STATS_LATENCY, 0.99) / 1e6
+        );
+    if (stats_count(STATS_FEED_LAG) > 0)
+        fprintf(
+          stderr,
+          "feed lag from clocks p50 %.1f s, p99 %.1f s\n",
+          stats_percentile(STATS_FEED_LAG, 0.50) / 1e9,
+          stats_percentile(STATS_FEED_LAG, 0.99) / 1e9
+        );
+    if (record_path != NULL)
+        fprintf(
+          stderr, "recorded %zu bytes to %s\n", recorder.written, record_path
+        );
+}
+
+static int
+parse_channels(char* list)
+{
+    channel_count = 0;
+    for (char* name = strtok(list, ","); name != NULL;
+         name       = strtok(NULL, ",")) {
+        if (channel_count == FEED_MAX_CHANNELS)
+            return -1;
+        channels[channel_count++] = name;
+    }
+    return channel_count > 0 ? 0 : -1;
+}
+
+static void
+usage(const char* name)
+{
+    printf("usage: %s [options]\n", name);
+    printf(
+      "  --soak           run without a display, report allocations\n"
+      "  --headless       write games and moves to stdout as JSON lines\n"
+      "  --fps N          redraw at most N times per second (default %d)\n"
+      "  --eval N         evaluate positions on N threads, 0 for none\n"
+      "                   (default %d)\n"
+      "  --book FILE      name openings from FILE (default %s)\n"
+      "  --channels LIST  watch several TV channels side by side, for\n"
+      "                   example top,bullet,blitz,rapid,classical\n"
+      "  --record FILE    append every frame to FILE in a compact log\n"
+      "  --replay FILE    play back a recording instead of the feed\n"
+      "  --speed X        replay at X times real time, 0 for flat out\n"
+      "  --game N         start the replay at the Nth recorded game\n"
+      "  --serve ADDR     share the feed with litv clients on ADDR, a\n"
+      "                   Unix socket path or HOST:PORT\n"
+      "  --connect ADDR   watch the feed of a litv server\n"
+      "  --stats-file F   append pipeline statistics to F every %d s\n"
+      "press s to show or hide pipeline statistics, p to pause and resume\n"
+      "the boards, q to quit, and the arrow keys, page up/down and\n"
+      "home/end to step through the moves of a game\n",
+      SCHED_DEFAULT_FPS,
+      EVAL_DEFAULT_WORKERS,
+      LITV_BOOK,
+      STATS_DUMP_MS / 1000
+    );
 }
 
 int
-main()
+main(int argc, char** argv)
 {
-    gfx_init();
-    feed_init(on_data);
-    gfx_destroy();
+    static struct option options[] = {
+        { "soak", no_argument, NULL, 's' },
+        { "headless", no_argument, NULL, 'H' },
+        { "fps", required_argument, NULL, 'f' },
+        { "eval", required_argument, NULL, 'e' },
+        { "book", required_argument, NULL, 'b' },
+        { "channels", required_argument, NULL, 'c' },
+        { "record", required_argument, NULL, 'r' },
+        { "replay", required_argument, NULL, 'p' },
+        { "speed", required_argument, NULL, 'x' },
+        { "game", required_argument, NULL, 'g' },
+        { "serve", required_argument, NULL, 'l' },
+        { "connect", required_argument, NULL, 'C' },
+        { "stats-file", required_argument, NULL, 'S' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (opt) {
+            case 's':
+                soak_mode = 1;
+                break;
+            case 'H':
+                headless_mode = 1;
+                break;
+            case 'f':
+                max_fps = atoi(optarg);
+                if (max_fps <= 0) {
+                    fprintf(stderr, "--fps must be a positive number\n");
+                    return 1;
+                }
+                break;
+            case 'e':
+                eval_workers = atoi(optarg);
+                if (eval_workers < 0) {
+                    fprintf(stderr, "--eval takes a number of threads\n");
+                    return 1;
+                }
+                break;
+            case 'b':
+                book_path = optarg;
+                break;
+            case 'c':
+                if (parse_channels(optarg) != 0) {
+                    fprintf(
+                      stderr,
+                      "--channels takes 1 to %d comma separated names\n",
+                      FEED_MAX_CHANNELS
+                    );
+                    return 1;
+                }
+                break;
+            case 'r':
+                record_path = optarg;
+                break;
+            case 'p':
+                replay_path = optarg;
+                break;
+            case 'x':
+                replay_speed = strtod(optarg, NULL);
+                if (replay_speed < 0) {
+                    fprintf(stderr, "--speed must not be negative\n");
+                    return 1;
+                }
+                break;
+            case 'g':
+                if (atoi(optarg) <= 0) {
+                    fprintf(stderr, "--game counts from 1\n");
+                    return 1;
+                }
+                replay_game = (size_t)atoi(optarg);
+                break;
+            case 'l':
+                serve_addr = optarg;
+                break;
+            case 'C':
+                connect_addr = optarg;
+                break;
+            case 'S':
+                stats_file = fopen(optarg, "a");
+                if (stats_file == NULL) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (connect_addr != NULL && (replay_path != NULL || channel_count > 0)) {
+        fprintf(stderr, "--connect takes its channels from the server\n");
+        return 1;
+    }
+
+    if (replay_path != NULL && open_replay() != 0)
+        return 1;
+    if (connect_addr != NULL && open_client() != 0)
+        return 1;
+    if (channel_count == 0)
+        channels[channel_count++] = "top";
+    for (int i = 0; i < channel_count; i++)
+        game_init(&games[i]);
+    // without the default book there are no opening names, that's all
+    if (book_open(book_path != NULL ? book_path : LITV_BOOK) != 0 &&
+        book_path != NULL) {
+        fprintf(stderr, "%s: not a readable opening book\n", book_path);
+        return 1;
+    }
+    if (queue_init(&queue) != 0) {
+        perror("eventfd");
+        return 1;
+    }
+
+    // the position tables are built lazily, which is not thread safe,
+    // and the server, network and render threads all use them
+    pos_init();
+
+    if (record_path != NULL &&
+        record_open(&recorder, record_path, channels, channel_count) != 0) {
+        perror(record_path);
+        return 1;
+    }
+
+    if (serve_addr != NULL &&
+        serve_start(serve_addr, channels, channel_count) != 0) {
+        perror(serve_addr);
+        return 1;
+    }
+
+    if (soak_mode)
+        soak_window_allocs = memstat_allocs();
+
+    // signals go to the render loop, never into the other threads
+    sigset_t blocked, mask;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigaddset(&blocked, SIGWINCH);
+    pthread_sigmask(SIG_BLOCK, &blocked, &mask);
+    // frames wait in the queue until the render loop is up
+    pthread_t network;
+    if (pthread_create(&network, NULL, network_main, NULL) != 0) {
+        pthread_sigmask(SIG_SETMASK, &mask, NULL);
+        fprintf(stderr, "failed to start the network thread\n");
+        return 1;
+    }
+    if (!soak_mode)
+        open_render();
+    watch_signals();
+    if (render != NULL && eval_workers > 0) {
+        // no more searching threads than there are cores
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cpus > 0 && cpus < eval_workers)
+            eval_workers = (int)cpus;
+        eval_start(channel_count, eval_workers);
+    }
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+    // empty boards rather than a blank screen until the first frame
+    if (render == &render_curses)
+        draw_all();
+    render_loop();
+    pthread_join(network, NULL);
+    if (replay_path != NULL) {
+        // keep the final position up until a key is pressed
+        if (render != NULL && render->key != NULL && !quitting)
+            wait_key();
+        replay_close(&replay);
+    }
+    if (record_path != NULL && record_close(&recorder) != 0)
+        fprintf(stderr, "%s: recording was cut short\n", record_path);
+    if (serve_addr != NULL)
+        serve_stop();
+
+    eval_stop();
+    if (render != NULL)
+        render->destroy();
+    print_stats();
+    if (stats_file != NULL) {
+        stats_dump(stats_file);
+        fclose(stats_file);
+    }
+    queue_destroy(&queue);
+    book_close();
     return 0;
 }
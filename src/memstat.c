@@ -0,0 +1,79 @@
+/* Allocation Counters
+ *
+ * Thin wrappers around the system allocator that count how often
+ * we go to the heap. Our own modules allocate through them, and
+ * memstat_hook_curl routes libcurl's allocations through them as
+ * well, so the soak mode can tell whether the per-frame path has
+ * started allocating again. The counters are shared by the network
+ * and render threads.
+ */
+
+#include "memstat.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <curl/curl.h>
+
+static atomic_size_t allocs;
+static atomic_size_t frees;
+
+void*
+memstat_malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    return malloc(size);
+}
+
+void*
+memstat_calloc(size_t nmemb, size_t size)
+{
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    return calloc(nmemb, size);
+}
+
+void*
+memstat_realloc(void* ptr, size_t size)
+{
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    return realloc(ptr, size);
+}
+
+char*
+memstat_strdup(const char* str)
+{
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    return strdup(str);
+}
+
+void
+memstat_free(void* ptr)
+{
+    if (ptr != NULL)
+        atomic_fetch_add_explicit(&frees, 1, memory_order_relaxed);
+    free(ptr);
+}
+
+void
+memstat_hook_curl()
+{
+    curl_global_init_mem(
+      CURL_GLOBAL_DEFAULT,
+      memstat_malloc,
+      memstat_free,
+      memstat_realloc,
+      memstat_strdup,
+      memstat_calloc
+    );
+}
+
+size_t
+memstat_allocs()
+{
+    return atomic_load_explicit(&allocs, memory_order_relaxed);
+}
+
+size_t
+memstat_frees()
+{
+    return atomic_load_explicit(&frees, memory_order_relaxed);
+}
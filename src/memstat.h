@@ -0,0 +1,30 @@
+#ifndef MEMSTAT_H
+#define MEMSTAT_H
+
+#include <stddef.h>
+
+void*
+memstat_malloc(size_t size);
+
+void*
+memstat_calloc(size_t nmemb, size_t size);
+
+void*
+memstat_realloc(void* ptr, size_t size);
+
+char*
+memstat_strdup(const char* str);
+
+void
+memstat_free(void* ptr);
+
+void
+memstat_hook_curl();
+
+size_t
+memstat_allocs();
+
+size_t
+memstat_frees();
+
+#endif
@@ -0,0 +1,162 @@
+/* Sockets
+ *
+ * Listening and connecting for --serve and --connect, on either a Unix
+ * socket or TCP. The listener is non-blocking for the server's epoll
+ * loop; a connection is blocking, since the client only ever waits on
+ * its one socket. TCP connections turn off Nagle, as the server sends
+ * many small batches that should go out as soon as they are written.
+ */
+
+#include "net.h"
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define NET_BACKLOG  16
+#define NET_HOST_MAX 256
+
+static const char*
+unix_path(const char* addr)
+{
+    if (strncmp(addr, "unix:", 5) == 0)
+        return addr + 5;
+    return strchr(addr, '/') != NULL ? addr : NULL;
+}
+
+static int
+unix_address(const char* path, struct sockaddr_un* sun)
+{
+    memset(sun, 0, sizeof(*sun));
+    sun->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(sun->sun_path))
+        return -1;
+    strcpy(sun->sun_path, path);
+    return 0;
+}
+
+// splits HOST:PORT, dropping the brackets around an IPv6 host
+static int
+split(const char* addr, char* host, const char** port)
+{
+    const char* colon = strrchr(addr, ':');
+    if (colon == NULL || colon[1] == '\0')
+        return -1;
+    size_t len = (size_t)(colon - addr);
+    if (len >= 2 && addr[0] == '[' && addr[len - 1] == ']') {
+        addr++;
+        len -= 2;
+    }
+    if (len >= NET_HOST_MAX)
+        return -1;
+    memcpy(host, addr, len);
+    host[len] = '\0';
+    *port     = colon + 1;
+    return 0;
+}
+
+static struct addrinfo*
+resolve(const char* addr, int passive)
+{
+    char host[NET_HOST_MAX];
+    const char* port;
+    if (split(addr, host, &port) != 0)
+        return NULL;
+    struct addrinfo hints = { 0 }, *list;
+    hints.ai_family       = AF_UNSPEC;
+    hints.ai_socktype     = SOCK_STREAM;
+    hints.ai_flags        = passive ? AI_PASSIVE : 0;
+    if (getaddrinfo(host[0] ? host : NULL, port, &hints, &list) != 0)
+        return NULL;
+    return list;
+}
+
+static int
+listen_unix(const char* path)
+{
+    struct sockaddr_un sun;
+    if (unix_address(path, &sun) != 0)
+        return -1;
+    // a socket left behind by a server that died is in the way
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (bind(fd, (struct sockaddr*)&sun, sizeof(sun)) != 0 ||
+        listen(fd, NET_BACKLOG) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Returns a non-blocking listening socket, or -1. */
+int
+net_listen(const char* addr)
+{
+    const char* path = unix_path(addr);
+    if (path != NULL)
+        return listen_unix(path);
+
+    struct addrinfo* list = resolve(addr, 1);
+    int fd                = -1;
+    for (struct addrinfo* ai = list; ai != NULL && fd < 0; ai = ai->ai_next) {
+        fd = socket(
+          ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, 0
+        );
+        if (fd < 0)
+            continue;
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 ||
+            listen(fd, NET_BACKLOG) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (list != NULL)
+        freeaddrinfo(list);
+    return fd;
+}
+
+/* Returns a connected, blocking socket, or -1. */
+int
+net_connect(const char* addr)
+{
+    const char* path = unix_path(addr);
+    if (path != NULL) {
+        struct sockaddr_un sun;
+        if (unix_address(path, &sun) != 0)
+            return -1;
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr*)&sun, sizeof(sun)) != 0) {
+            close(fd);
+            fd = -1;
+        }
+        return fd;
+    }
+
+    struct addrinfo* list = resolve(addr, 0);
+    int fd                = -1;
+    for (struct addrinfo* ai = list; ai != NULL && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+            continue;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    if (list != NULL)
+        freeaddrinfo(list);
+    return fd;
+}
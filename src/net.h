@@ -0,0 +1,15 @@
+#ifndef NET_H
+#define NET_H
+
+/* Addresses are "unix:PATH" or anything with a '/' in it for a Unix
+ * socket, otherwise "HOST:PORT"; an empty host listens on every
+ * interface and connects to the local machine.
+ */
+
+int
+net_listen(const char* addr);
+
+int
+net_connect(const char* addr);
+
+#endif
@@ -0,0 +1,628 @@
+/* Position
+ *
+ * Keeps the position of a game up to date by applying the UCI move
+ * from each "fen" frame, rather than decoding the whole FEN every
+ * time. The FEN in the frame is still the authority: it is compared
+ * against the mailbox without being decoded, and the position is
+ * rebuilt from it only when the two disagree (for example after a
+ * skipped frame).
+ *
+ * The bitboards make derived views cheap: attacked squares, check
+ * and material are a handful of mask operations instead of scans
+ * over the 64 squares. They also drive move generation for the
+ * evaluation search, which is the only user that needs legal moves.
+ *
+ * pos_hash is a Zobrist hash of the placement and the side to move.
+ * Opening books store it, so its keys come from a fixed seed and must
+ * never change; castling rights and en passant are left out because
+ * the feed's FEN does not carry them.
+ */
+
+#include "position.h"
+#include <ctype.h>
+
+#define BIT(sq)        ((uint64_t)1 << (sq))
+#define FILE_OF(sq)    ((sq) % 8)
+#define RANK_ROW(sq)   ((sq) / 8)
+#define ON_BOARD(r, f) ((r) >= 0 && (r) < 8 && (f) >= 0 && (f) < 8)
+
+static const char PIECE_CHARS[] = "PNBRQKpnbrqk";
+static const char PROMOTIONS[]  = "nbrqk";
+static const int PIECE_VALUES[] = { 1, 3, 3, 5, 9, 0 };
+
+static uint64_t knight_attacks[BOARD_SIZE];
+static uint64_t king_attacks[BOARD_SIZE];
+static uint64_t zobrist_pieces[PIECE_KINDS][BOARD_SIZE];
+static uint64_t zobrist_black;
+static int tables_ready;
+
+#define ZOBRIST_SEED 0x4c69545620454f43ULL
+
+// splitmix64, which is all a table of fixed random keys needs
+static uint64_t
+next_key(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z          = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z          = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t
+step_mask(int sq, const int (*deltas)[2], int count)
+{
+    uint64_t mask = 0;
+    for (int i = 0; i < count; i++) {
+        int r = RANK_ROW(sq) + deltas[i][0];
+        int f = FILE_OF(sq) + deltas[i][1];
+        if (ON_BOARD(r, f))
+            mask |= BIT(r * 8 + f);
+    }
+    return mask;
+}
+
+static void
+init_tables()
+{
+    if (tables_ready)
+        return;
+    static const int knight[8][2] = { { -2, -1 }, { -2, 1 }, { -1, -2 },
+                                      { -1, 2 },  { 1, -2 }, { 1, 2 },
+                                      { 2, -1 },  { 2, 1 } };
+    static const int king[8][2]   = { { -1, -1 }, { -1, 0 }, { -1, 1 },
+                                      { 0, -1 },  { 0, 1 },  { 1, -1 },
+                                      { 1, 0 },   { 1, 1 } };
+    for (int sq = 0; sq < BOARD_SIZE; sq++) {
+        knight_attacks[sq] = step_mask(sq, knight, 8);
+        king_attacks[sq]   = step_mask(sq, king, 8);
+    }
+    uint64_t state = ZOBRIST_SEED;
+    for (int piece = 0; piece < PIECE_KINDS; piece++)
+        for (int sq = 0; sq < BOARD_SIZE; sq++)
+            zobrist_pieces[piece][sq] = next_key(&state);
+    zobrist_black = next_key(&state);
+    tables_ready  = 1;
+}
+
+/* Builds the attack tables. Everything here does it on first use, but
+ * that is only safe on one thread, so call it before positions are
+ * used from several.
+ */
+void
+pos_init()
+{
+    init_tables();
+}
+
+uint64_t
+pos_hash(const position_t* pos)
+{
+    if (!tables_ready)
+        init_tables();
+    uint64_t hash = pos->side == BLACK ? zobrist_black : 0;
+    for (int piece = 0; piece < PIECE_KINDS; piece++)
+        for (uint64_t bb = pos->pieces[piece]; bb; bb &= bb - 1)
+            hash ^= zobrist_pieces[piece][__builtin_ctzll(bb)];
+    return hash;
+}
+
+int
+pos_piece_index(char piece)
+{
+    for (int i = 0; i < PIECE_KINDS; i++)
+        if (PIECE_CHARS[i] == piece)
+            return i;
+    return -1;
+}
+
+int
+pos_square_index(const char* name)
+{
+    if (name[0] < 'a' || name[0] > 'h' || name[1] < '1' || name[1] > '8')
+        return -1;
+    return ('8' - name[1]) * 8 + (name[0] - 'a');
+}
+
+/* A UCI move in 16 bits, for the recorder and the move history. */
+int
+pos_pack_move(const char* uci)
+{
+    int from = pos_square_index(uci);
+    int to   = from < 0 ? -1 : pos_square_index(uci + 2);
+    if (to < 0)
+        return -1;
+    int promo = 0;
+    if (uci[4] != '\0') {
+        const char* p = strchr(PROMOTIONS, uci[4]);
+        if (p == NULL || uci[5] != '\0')
+            return -1;
+        promo = (int)(p - PROMOTIONS) + 1;
+    }
+    return from | to << 6 | promo << 12;
+}
+
+int
+pos_unpack_move(int move, char* uci)
+{
+    int from  = MOVE_FROM(move);
+    int to    = MOVE_TO(move);
+    int promo = MOVE_PROMO(move);
+    if (promo > (int)sizeof(PROMOTIONS) - 1)
+        return -1;
+    uci[0] = (char)('a' + from % 8);
+    uci[1] = (char)('8' - from / 8);
+    uci[2] = (char)('a' + to % 8);
+    uci[3] = (char)('8' - to / 8);
+    uci[4] = promo ? PROMOTIONS[promo - 1] : '\0';
+    uci[5] = '\0';
+    return 0;
+}
+
+static void
+put_piece(position_t* pos, int sq, char piece)
+{
+    int index = pos_piece_index(piece);
+    if (index < 0)
+        return;
+    pos->pieces[index] |= BIT(sq);
+    pos->occupied[index / 6] |= BIT(sq);
+    pos->mailbox[sq] = piece;
+}
+
+static void
+take_piece(position_t* pos, int sq)
+{
+    int index = pos_piece_index(pos->mailbox[sq]);
+    if (index >= 0) {
+        pos->pieces[index] &= ~BIT(sq);
+        pos->occupied[index / 6] &= ~BIT(sq);
+    }
+    pos->mailbox[sq] = '.';
+}
+
+/* The TV feed only sends the placement and the side to move, so any
+ * other field is optional. Missing castling rights are inferred from
+ * kings and rooks standing on their original squares.
+ */
+int
+pos_from_fen(position_t* pos, const char* fen)
+{
+    char board[BOARD_SIZE + 1];
+    if (fen_to_board(fen, board) != 0)
+        return -1;
+
+    if (!tables_ready)
+        init_tables();
+    memset(pos, 0, sizeof(*pos));
+    for (int sq = 0; sq < BOARD_SIZE; sq++) {
+        pos->mailbox[sq] = '.';
+        put_piece(pos, sq, board[sq]);
+    }
+
+    const char* field = strchr(fen, ' ');
+    pos->side         = field != NULL && field[1] == 'b' ? BLACK : WHITE;
+    pos->ep           = -1;
+
+    field = field != NULL ? strchr(field + 1, ' ') : NULL;
+    if (field != NULL) {
+        for (field++; *field != '\0' && *field != ' '; field++) {
+            switch (*field) {
+                case 'K':
+                    pos->castling |= CASTLE_WK;
+                    break;
+                case 'Q':
+                    pos->castling |= CASTLE_WQ;
+                    break;
+                case 'k':
+                    pos->castling |= CASTLE_BK;
+                    break;
+                case 'q':
+                    pos->castling |= CASTLE_BQ;
+                    break;
+            }
+        }
+        if (*field == ' ')
+            pos->ep = pos_square_index(field + 1);
+    } else {
+        if (board[60] == 'K' && board[63] == 'R')
+            pos->castling |= CASTLE_WK;
+        if (board[60] == 'K' && board[56] == 'R')
+            pos->castling |= CASTLE_WQ;
+        if (board[4] == 'k' && board[7] == 'r')
+            pos->castling |= CASTLE_BK;
+        if (board[4] == 'k' && board[0] == 'r')
+            pos->castling |= CASTLE_BQ;
+    }
+    return 0;
+}
+
+/* Writes the board and side to move in the same two-field form the
+ * TV feed uses for moves, e.g. "8/8/8/8/8/8/8/K6k w". Returns the
+ * length, or -1 when it does not fit.
+ */
+int
+pos_to_fen(const position_t* pos, char* fen, size_t size)
+{
+    size_t len = 0;
+    for (int row = 0; row < 8; row++) {
+        int empty = 0;
+        for (int file = 0; file < 8; file++) {
+            char piece = pos->mailbox[row * 8 + file];
+            if (piece == '.') {
+                empty++;
+                continue;
+            }
+            if (empty && len < size)
+                fen[len++] = (char)('0' + empty);
+            if (len < size)
+                fen[len++] = piece;
+            empty = 0;
+        }
+        if (empty && len < size)
+            fen[len++] = (char)('0' + empty);
+        if (row < 7 && len < size)
+            fen[len++] = '/';
+    }
+    if (len + 3 > size)
+        return -1;
+    fen[len++] = ' ';
+    fen[len++] = pos->side == BLACK ? 'b' : 'w';
+    fen[len]   = '\0';
+    return (int)len;
+}
+
+static int
+castling_mask(int sq)
+{
+    switch (sq) {
+        case 0:
+            return CASTLE_BQ;
+        case 4:
+            return CASTLE_BK | CASTLE_BQ;
+        case 7:
+            return CASTLE_BK;
+        case 56:
+            return CASTLE_WQ;
+        case 60:
+            return CASTLE_WK | CASTLE_WQ;
+        case 63:
+            return CASTLE_WK;
+    }
+    return 0;
+}
+
+/* Apply a move in UCI notation, e.g. "e2e4" or "e7e8q". Castling is
+ * accepted both as the king's two square step and as king-takes-rook.
+ * Returns -1 if the move does not fit the position.
+ */
+int
+pos_apply_uci(position_t* pos, const char* uci)
+{
+    int from = pos_square_index(uci);
+    int to   = from < 0 ? -1 : pos_square_index(uci + 2);
+    if (to < 0)
+        return -1;
+    int promo = 0;
+    if (uci[4] != '\0') {
+        const char* p = strchr(PROMOTIONS, tolower((unsigned char)uci[4]));
+        promo         = p != NULL && *p != '\0' ? (int)(p - PROMOTIONS) + 1 : 0;
+    }
+    return pos_apply_move(pos, from | to << 6 | promo << 12);
+}
+
+// pos_apply_uci for a packed move
+int
+pos_apply_move(position_t* pos, int move)
+{
+    int from  = MOVE_FROM(move);
+    int to    = MOVE_TO(move);
+    int promo = MOVE_PROMO(move);
+    if (from == to || promo > (int)sizeof(PROMOTIONS) - 1)
+        return -1;
+
+    char piece = pos->mailbox[from];
+    int color  = isupper((unsigned char)piece) ? WHITE : BLACK;
+    if (piece == '.' || color != pos->side)
+        return -1;
+
+    char target = pos->mailbox[to];
+    int is_king = piece == 'K' || piece == 'k';
+    int is_pawn = piece == 'P' || piece == 'p';
+    int to_own  = target != '.' && (pos->occupied[color] & BIT(to));
+    int castle  = is_king && RANK_ROW(from) == RANK_ROW(to) &&
+                 (to_own || FILE_OF(from) - FILE_OF(to) == 2 ||
+                  FILE_OF(to) - FILE_OF(from) == 2);
+    if (to_own && !castle)
+        return -1;
+
+    int ep = -1;
+    if (castle) {
+        int row      = RANK_ROW(from) * 8;
+        int kingside = FILE_OF(to) > FILE_OF(from);
+        int rook     = to_own ? to : row + (kingside ? 7 : 0);
+        char rook_ch = pos->mailbox[rook];
+        take_piece(pos, from);
+        take_piece(pos, rook);
+        put_piece(pos, row + (kingside ? 6 : 2), piece);
+        put_piece(pos, row + (kingside ? 5 : 3), rook_ch);
+    } else {
+        if (is_pawn && target == '.' && FILE_OF(from) != FILE_OF(to))
+            take_piece(pos, to + (color == WHITE ? 8 : -8));
+        if (is_pawn && (from - to == 16 || to - from == 16))
+            ep = (from + to) / 2;
+        if (target != '.')
+            take_piece(pos, to);
+        take_piece(pos, from);
+        if (promo && is_pawn) {
+            char p = PROMOTIONS[promo - 1];
+            piece  = color == WHITE ? (char)toupper(p) : p;
+        }
+        put_piece(pos, to, piece);
+    }
+
+    pos->castling &= ~(castling_mask(from) | castling_mask(to));
+    pos->ep   = ep;
+    pos->side = !pos->side;
+    return 0;
+}
+
+/* Compare the position against the placement and side to move of a
+ * FEN, without decoding it into a board.
+ */
+int
+pos_matches_fen(const position_t* pos, const char* fen)
+{
+    int sq = 0;
+    const char* p;
+    for (p = fen; *p != '\0' && *p != ' ' && *p != '['; p++) {
+        if (*p == '/' || *p == '~')
+            continue;
+        if (*p >= '1' && *p <= '8') {
+            for (int n = *p - '0'; n > 0; n--, sq++)
+                if (sq >= BOARD_SIZE || pos->mailbox[sq] != '.')
+                    return 0;
+        } else if (sq >= BOARD_SIZE || pos->mailbox[sq++] != *p) {
+            return 0;
+        }
+    }
+    if (sq != BOARD_SIZE)
+        return 0;
+    while (*p != '\0' && *p != ' ')
+        p++;
+    if (*p == ' ' && (p[1] == 'w' || p[1] == 'b'))
+        return (p[1] == 'b') == (pos->side == BLACK);
+    return 1;
+}
+
+static uint64_t
+slide(int sq, uint64_t occupied, int dr, int df)
+{
+    uint64_t mask = 0;
+    int r         = RANK_ROW(sq) + dr;
+    int f         = FILE_OF(sq) + df;
+    for (; ON_BOARD(r, f); r += dr, f += df) {
+        mask |= BIT(r * 8 + f);
+        if (occupied & BIT(r * 8 + f))
+            break;
+    }
+    return mask;
+}
+
+static uint64_t
+bishop_attacks(int sq, uint64_t occupied)
+{
+    return slide(sq, occupied, -1, -1) | slide(sq, occupied, -1, 1) |
+           slide(sq, occupied, 1, -1) | slide(sq, occupied, 1, 1);
+}
+
+static uint64_t
+rook_attacks(int sq, uint64_t occupied)
+{
+    return slide(sq, occupied, -1, 0) | slide(sq, occupied, 1, 0) |
+           slide(sq, occupied, 0, -1) | slide(sq, occupied, 0, 1);
+}
+
+static uint64_t
+pawn_attacks(uint64_t pawns, int side)
+{
+    const uint64_t not_a = 0xfefefefefefefefeULL;
+    const uint64_t not_h = 0x7f7f7f7f7f7f7f7fULL;
+    // white pawns attack towards a8, which is the low end of the board
+    if (side == WHITE)
+        return ((pawns & not_a) >> 9) | ((pawns & not_h) >> 7);
+    return ((pawns & not_a) << 7) | ((pawns & not_h) << 9);
+}
+
+uint64_t
+pos_attacks(const position_t* pos, int side)
+{
+    if (!tables_ready)
+        init_tables();
+    const uint64_t* own = &pos->pieces[side * 6];
+    uint64_t occupied   = pos->occupied[WHITE] | pos->occupied[BLACK];
+    uint64_t attacks    = pawn_attacks(own[0], side);
+    uint64_t bb;
+
+    for (bb = own[1]; bb; bb &= bb - 1)
+        attacks |= knight_attacks[__builtin_ctzll(bb)];
+    for (bb = own[2] | own[4]; bb; bb &= bb - 1)
+        attacks |= bishop_attacks(__builtin_ctzll(bb), occupied);
+    for (bb = own[3] | own[4]; bb; bb &= bb - 1)
+        attacks |= rook_attacks(__builtin_ctzll(bb), occupied);
+    for (bb = own[5]; bb; bb &= bb - 1)
+        attacks |= king_attacks[__builtin_ctzll(bb)];
+    return attacks;
+}
+
+int
+pos_king_square(const position_t* pos, int side)
+{
+    uint64_t king = pos->pieces[side * 6 + 5];
+    return king ? __builtin_ctzll(king) : -1;
+}
+
+/* Whether side by attacks sq, looking outwards from the square rather
+ * than building every attack of the side.
+ */
+int
+pos_attacked(const position_t* pos, int sq, int by)
+{
+    if (!tables_ready)
+        init_tables();
+    const uint64_t* their = &pos->pieces[by * 6];
+    uint64_t occupied     = pos->occupied[WHITE] | pos->occupied[BLACK];
+    // a pawn of by attacks sq where a pawn of the other side on sq would
+    return (pawn_attacks(BIT(sq), !by) & their[0]) ||
+           (knight_attacks[sq] & their[1]) || (king_attacks[sq] & their[5]) ||
+           (bishop_attacks(sq, occupied) & (their[2] | their[4])) ||
+           (rook_attacks(sq, occupied) & (their[3] | their[4]));
+}
+
+int
+pos_in_check(const position_t* pos, int side)
+{
+    int king = pos_king_square(pos, side);
+    return king >= 0 && pos_attacked(pos, king, !side);
+}
+
+static int
+add_move(const position_t* pos, uint16_t* moves, int count, int move)
+{
+    position_t next = *pos;
+    if (pos_apply_move(&next, move) == 0 && !pos_in_check(&next, pos->side))
+        moves[count++] = (uint16_t)move;
+    return count;
+}
+
+// to squares in targets from one square, all but pawns
+static int
+add_moves(
+  const position_t* pos,
+  uint16_t* moves,
+  int count,
+  int from,
+  uint64_t targets
+)
+{
+    for (; targets; targets &= targets - 1) {
+        int to = __builtin_ctzll(targets);
+        count  = add_move(pos, moves, count, from | to << 6);
+    }
+    return count;
+}
+
+static int
+add_pawn_move(const position_t* pos, uint16_t* moves, int count, int move)
+{
+    int row = RANK_ROW(MOVE_TO(move));
+    if (row != 0 && row != 7)
+        return add_move(pos, moves, count, move);
+    // knight, bishop, rook and queen, as pos_pack_move numbers them
+    for (int promo = 1; promo <= 4; promo++)
+        count = add_move(pos, moves, count, move | promo << 12);
+    return count;
+}
+
+static int
+add_castles(const position_t* pos, uint16_t* moves, int count)
+{
+    // king, rook, right, squares that must be empty, then safe squares
+    static const int castles[4][7] = {
+        { 60, 63, CASTLE_WK, 61, 62, 61, 62 },
+        { 60, 56, CASTLE_WQ, 59, 58, 59, 58 },
+        { 4, 7, CASTLE_BK, 5, 6, 5, 6 },
+        { 4, 0, CASTLE_BQ, 3, 2, 3, 2 },
+    };
+    int side     = pos->side;
+    uint64_t occ = pos->occupied[WHITE] | pos->occupied[BLACK];
+    char king    = side == WHITE ? 'K' : 'k';
+    char rook    = side == WHITE ? 'R' : 'r';
+    for (int i = side * 2; i < side * 2 + 2; i++) {
+        const int* c = castles[i];
+        if (!(pos->castling & c[2]) || pos->mailbox[c[0]] != king ||
+            pos->mailbox[c[1]] != rook || (occ & (BIT(c[3]) | BIT(c[4]))))
+            continue;
+        // queenside also needs the knight's square empty
+        if (c[1] % 8 == 0 && (occ & BIT(c[1] + 1)))
+            continue;
+        if (pos_attacked(pos, c[0], !side) || pos_attacked(pos, c[5], !side) ||
+            pos_attacked(pos, c[6], !side))
+            continue;
+        moves[count++] = (uint16_t)(c[0] | c[4] << 6);
+    }
+    return count;
+}
+
+/* Every legal move of the side to move, packed as by pos_pack_move,
+ * or with captures set only the captures and en passant. Castling is
+ * the king's two square step. Returns how many were written, at most
+ * POS_MAX_MOVES.
+ */
+int
+pos_moves(const position_t* pos, uint16_t* moves, int captures)
+{
+    if (!tables_ready)
+        init_tables();
+    int side            = pos->side;
+    const uint64_t* own = &pos->pieces[side * 6];
+    uint64_t occupied   = pos->occupied[WHITE] | pos->occupied[BLACK];
+    uint64_t targets    = ~pos->occupied[side];
+    int forward         = side == WHITE ? -8 : 8;
+    int count           = 0;
+    uint64_t bb;
+
+    if (captures)
+        targets = pos->occupied[!side];
+    for (bb = own[0]; bb; bb &= bb - 1) {
+        int from  = __builtin_ctzll(bb);
+        int to    = from + forward;
+        int start = side == WHITE ? 6 : 1;
+        int ahead = to >= 0 && to < BOARD_SIZE;
+        if (!captures && ahead && !(occupied & BIT(to))) {
+            count = add_pawn_move(pos, moves, count, from | to << 6);
+            int two = to + forward;
+            if (RANK_ROW(from) == start && !(occupied & BIT(two)))
+                count = add_move(pos, moves, count, from | two << 6);
+        }
+        uint64_t hits = pawn_attacks(BIT(from), side);
+        uint64_t ep   = pos->ep >= 0 ? BIT(pos->ep) : 0;
+        for (hits &= pos->occupied[!side] | ep; hits; hits &= hits - 1)
+            count = add_pawn_move(
+              pos, moves, count, from | __builtin_ctzll(hits) << 6
+            );
+    }
+    for (bb = own[1]; bb; bb &= bb - 1) {
+        int from    = __builtin_ctzll(bb);
+        uint64_t to = knight_attacks[from] & targets;
+        count       = add_moves(pos, moves, count, from, to);
+    }
+    for (bb = own[2] | own[4]; bb; bb &= bb - 1) {
+        int from    = __builtin_ctzll(bb);
+        uint64_t to = bishop_attacks(from, occupied) & targets;
+        count       = add_moves(pos, moves, count, from, to);
+    }
+    for (bb = own[3] | own[4]; bb; bb &= bb - 1) {
+        int from    = __builtin_ctzll(bb);
+        uint64_t to = rook_attacks(from, occupied) & targets;
+        count       = add_moves(pos, moves, count, from, to);
+    }
+    for (bb = own[5]; bb; bb &= bb - 1) {
+        int from    = __builtin_ctzll(bb);
+        uint64_t to = king_attacks[from] & targets;
+        count       = add_moves(pos, moves, count, from, to);
+    }
+    if (!captures)
+        count = add_castles(pos, moves, count);
+    return count;
+}
+
+int
+pos_material(const position_t* pos, int side)
+{
+    int total = 0;
+    for (int i = 0; i < 6; i++) {
+        int count = __builtin_popcountll(pos->pieces[side * 6 + i]);
+        total += PIECE_VALUES[i] * count;
+    }
+    return total;
+}
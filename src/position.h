@@ -0,0 +1,91 @@
+#ifndef POSITION_H
+#define POSITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fen.h"
+
+#define WHITE 0
+#define BLACK 1
+
+#define CASTLE_WK 0x1
+#define CASTLE_WQ 0x2
+#define CASTLE_BK 0x4
+#define CASTLE_BQ 0x8
+
+#define PIECE_KINDS 12
+
+// more than any position has legal moves
+#define POS_MAX_MOVES 256
+
+// packed move: from | to << 6 | promotion << 12
+#define MOVE_FROM(m)  ((m) & 0x3f)
+#define MOVE_TO(m)    (((m) >> 6) & 0x3f)
+#define MOVE_PROMO(m) (((m) >> 12) & 0x7)
+
+/* A position as 12 bitboards (PNBRQK for white, then black) plus a
+ * mailbox with the same square order as fen_to_board: bit/index 0 is
+ * a8, 7 is h8 and 63 is h1. Empty squares are '.' in the mailbox.
+ */
+typedef struct
+{
+    uint64_t pieces[PIECE_KINDS];
+    uint64_t occupied[2];
+    char mailbox[BOARD_SIZE];
+    int side;
+    int castling;
+    int ep;
+} position_t;
+
+void
+pos_init();
+
+int
+pos_from_fen(position_t* pos, const char* fen);
+
+int
+pos_to_fen(const position_t* pos, char* fen, size_t size);
+
+int
+pos_apply_uci(position_t* pos, const char* uci);
+
+int
+pos_apply_move(position_t* pos, int move);
+
+int
+pos_moves(const position_t* pos, uint16_t* moves, int captures);
+
+int
+pos_matches_fen(const position_t* pos, const char* fen);
+
+uint64_t
+pos_hash(const position_t* pos);
+
+int
+pos_piece_index(char piece);
+
+uint64_t
+pos_attacks(const position_t* pos, int side);
+
+int
+pos_king_square(const position_t* pos, int side);
+
+int
+pos_attacked(const position_t* pos, int sq, int by);
+
+int
+pos_in_check(const position_t* pos, int side);
+
+int
+pos_material(const position_t* pos, int side);
+
+int
+pos_square_index(const char* name);
+
+int
+pos_pack_move(const char* uci);
+
+int
+pos_unpack_move(int move, char* uci);
+
+#endif
@@ -0,0 +1,236 @@
+/* Frame Queue
+ *
+ * Hands decoded frames from the network thread to the render thread
+ * without locks. head is only written by the consumer and tail only
+ * by the producer; each side reads the other's index with acquire
+ * ordering so the slot contents are visible before the index is.
+ *
+ * The consumer sleeps in poll on an eventfd. The producer signals it
+ * once per batch of frames rather than once per frame.
+ *
+ * When the ring is full the producer does not wait: the socket would
+ * stall behind a stalled terminal. Frames go to a backlog instead,
+ * and every move is kept, since the game history is built from each
+ * one; the screen still shows only the latest position, because the
+ * consumer applies everything queued before it draws. A "featured"
+ * frame makes whatever its channel still has waiting moot, so it
+ * replaces all of it. The backlog holds up to QUEUE_BACKLOG_MAX
+ * frames, allocated up front so it never fails on the way; once full,
+ * new moves are dropped, and a featured frame, which is never lost,
+ * takes the place of the oldest move. Dropped frames are counted in
+ * stalls.
+ *
+ * The consumer takes from the backlog once the ring is empty, and the
+ * producer moves it back into the ring as room frees up. Only the
+ * backlog takes a lock, and only while it is in use.
+ *
+ * A replay has no socket to stall and every move to show, so it waits
+ * for room with queue_push_wait instead.
+ */
+
+#include "queue.h"
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "memstat.h"
+
+// far more than there can be channels, each with a featured frame
+#define QUEUE_BACKLOG_MAX 4096
+
+int
+queue_init(queue_t* queue)
+{
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->closed, 0);
+    atomic_init(&queue->stalls, 0);
+    atomic_init(&queue->backlog_waiting, 0);
+    queue->backlog_start = 0;
+    queue->backlog_count = 0;
+    pthread_mutex_init(&queue->lock, NULL);
+    // only the pages a stall writes to are ever touched
+    queue->backlog = memstat_malloc(QUEUE_BACKLOG_MAX * sizeof(frame_t));
+    queue->fd      = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return queue->fd < 0 || queue->backlog == NULL ? -1 : 0;
+}
+
+// producer only
+static int
+ring_push(queue_t* queue, const frame_t* frame)
+{
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&queue->head, memory_order_acquire) >=
+        QUEUE_CAPACITY)
+        return 0;
+    queue->slots[tail % QUEUE_CAPACITY] = *frame;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+// consumer only
+static int
+ring_pop(queue_t* queue, frame_t* frame)
+{
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&queue->tail, memory_order_acquire))
+        return 0;
+    *frame = queue->slots[head % QUEUE_CAPACITY];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return 1;
+}
+
+// the rest under lock
+static void
+backlog_take(queue_t* queue)
+{
+    queue->backlog_start++;
+    if (--queue->backlog_count == 0)
+        queue->backlog_start = 0;
+    atomic_store_explicit(
+      &queue->backlog_waiting, queue->backlog_count, memory_order_release
+    );
+}
+
+static void
+backlog_drop(queue_t* queue, size_t i)
+{
+    frame_t* waiting = queue->backlog + queue->backlog_start;
+    memmove(
+      &waiting[i],
+      &waiting[i + 1],
+      (queue->backlog_count - i - 1) * sizeof(*waiting)
+    );
+    queue->backlog_count--;
+    atomic_fetch_add_explicit(&queue->stalls, 1, memory_order_relaxed);
+}
+
+static void
+backlog_add(queue_t* queue, const frame_t* frame)
+{
+    frame_t* waiting = queue->backlog + queue->backlog_start;
+    if (frame->type == FRAME_FEATURED) {
+        for (size_t i = queue->backlog_count; i-- > 0;)
+            if (waiting[i].channel == frame->channel)
+                backlog_drop(queue, i);
+        if (queue->backlog_count == QUEUE_BACKLOG_MAX) {
+            // one featured frame per channel at most, the rest are moves
+            size_t i = 0;
+            while (waiting[i].type == FRAME_FEATURED)
+                i++;
+            backlog_drop(queue, i);
+        }
+    } else if (queue->backlog_count == QUEUE_BACKLOG_MAX) {
+        atomic_fetch_add_explicit(&queue->stalls, 1, memory_order_relaxed);
+        return;
+    }
+    if (queue->backlog_start + queue->backlog_count == QUEUE_BACKLOG_MAX) {
+        memmove(
+          queue->backlog, waiting, queue->backlog_count * sizeof(*waiting)
+        );
+        queue->backlog_start = 0;
+    }
+    queue->backlog[queue->backlog_start + queue->backlog_count++] = *frame;
+    atomic_store_explicit(
+      &queue->backlog_waiting, queue->backlog_count, memory_order_release
+    );
+}
+
+/* Never waits for the consumer. A frame goes to the ring when nothing
+ * is held back, and to the backlog otherwise.
+ */
+void
+queue_push(queue_t* queue, const frame_t* frame)
+{
+    if (atomic_load_explicit(&queue->backlog_waiting, memory_order_acquire) ==
+          0 &&
+        ring_push(queue, frame))
+        return;
+    pthread_mutex_lock(&queue->lock);
+    while (queue->backlog_count > 0 &&
+           ring_push(queue, &queue->backlog[queue->backlog_start]))
+        backlog_take(queue);
+    if (queue->backlog_count > 0 || !ring_push(queue, frame))
+        backlog_add(queue, frame);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/* Waits for room in the ring rather than coalescing, for producers
+ * that keep up with nothing but the consumer.
+ */
+void
+queue_push_wait(queue_t* queue, const frame_t* frame)
+{
+    while (!ring_push(queue, frame)) {
+        struct timespec pause = { 0, 1000000 };
+        queue_notify(queue);
+        nanosleep(&pause, NULL);
+    }
+}
+
+void
+queue_notify(queue_t* queue)
+{
+    uint64_t one = 1;
+    ssize_t r    = write(queue->fd, &one, sizeof(one));
+    (void)r;
+}
+
+int
+queue_pop(queue_t* queue, frame_t* frame)
+{
+    if (ring_pop(queue, frame))
+        return 1;
+    if (atomic_load_explicit(&queue->backlog_waiting, memory_order_acquire) ==
+        0)
+        return 0;
+    // the producer may have moved some of it into the ring meanwhile
+    pthread_mutex_lock(&queue->lock);
+    int r = ring_pop(queue, frame);
+    if (!r && queue->backlog_count > 0) {
+        *frame = queue->backlog[queue->backlog_start];
+        backlog_take(queue);
+        r = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return r;
+}
+
+int
+queue_fd(queue_t* queue)
+{
+    return queue->fd;
+}
+
+void
+queue_ack(queue_t* queue)
+{
+    uint64_t count;
+    ssize_t r = read(queue->fd, &count, sizeof(count));
+    (void)r;
+}
+
+void
+queue_close(queue_t* queue)
+{
+    atomic_store_explicit(&queue->closed, 1, memory_order_release);
+    queue_notify(queue);
+}
+
+int
+queue_is_closed(queue_t* queue)
+{
+    return atomic_load_explicit(&queue->closed, memory_order_acquire);
+}
+
+void
+queue_destroy(queue_t* queue)
+{
+    if (queue->fd >= 0)
+        close(queue->fd);
+    queue->fd = -1;
+    memstat_free(queue->backlog);
+    queue->backlog = NULL;
+    pthread_mutex_destroy(&queue->lock);
+}
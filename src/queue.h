@@ -0,0 +1,62 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include "frame.h"
+
+#define QUEUE_CAPACITY 256
+
+/* Single producer, single consumer ring of decoded frames. The
+ * producer publishes frames with queue_push and wakes the consumer
+ * with queue_notify; the consumer polls queue_fd and drains the ring
+ * with queue_pop. Frames that find the ring full wait in backlog,
+ * which only lock guards.
+ */
+typedef struct
+{
+    frame_t slots[QUEUE_CAPACITY];
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+    atomic_int closed;
+    atomic_size_t stalls;
+    int fd;
+    pthread_mutex_t lock;
+    frame_t* backlog;
+    size_t backlog_start;
+    size_t backlog_count;
+    atomic_size_t backlog_waiting;
+} queue_t;
+
+int
+queue_init(queue_t* queue);
+
+void
+queue_push(queue_t* queue, const frame_t* frame);
+
+void
+queue_push_wait(queue_t* queue, const frame_t* frame);
+
+void
+queue_notify(queue_t* queue);
+
+int
+queue_pop(queue_t* queue, frame_t* frame);
+
+int
+queue_fd(queue_t* queue);
+
+void
+queue_ack(queue_t* queue);
+
+void
+queue_close(queue_t* queue);
+
+int
+queue_is_closed(queue_t* queue);
+
+void
+queue_destroy(queue_t* queue);
+
+#endif
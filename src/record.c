@@ -0,0 +1,845 @@
+/* Recording
+ *
+ * Writes decoded frames to an append-only log in the format described
+ * in record.h. It runs on the network thread, straight from the feed
+ * callback, so nothing here can hold up the screen.
+ *
+ * Records are encoded into a fixed buffer that is written out with a
+ * single write() when it is half full or a second has passed, so a
+ * busy feed costs one system call per batch rather than one per move.
+ * Each channel keeps its own position to decide whether a frame can
+ * be stored as a two byte move instead of a full FEN, and players are
+ * interned: written once and referred to by id afterwards.
+ *
+ * The reading side is here too: record_read decodes one record with
+ * every length checked against the mapping, record_decode turns
+ * records back into frames, and record_load_index finds the game
+ * index through the footer or by reading the file.
+ *
+ * The same encoder also produces the live stream for --serve: instead
+ * of a file descriptor, every flushed batch goes to a sink.
+ */
+
+#include "record.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "memstat.h"
+
+#define RECORD_FLUSH_MS 1000
+
+static long long
+now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void
+put_byte(recorder_t* rec, int byte)
+{
+    rec->buf[rec->len++] = (unsigned char)byte;
+}
+
+static void
+put_varint(recorder_t* rec, unsigned long long value)
+{
+    while (value >= 0x80) {
+        put_byte(rec, (int)(value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    put_byte(rec, (int)value);
+}
+
+static void
+put_string(recorder_t* rec, const char* s)
+{
+    size_t len = strlen(s);
+    put_varint(rec, len);
+    memcpy(rec->buf + rec->len, s, len);
+    rec->len += len;
+}
+
+static void
+put_clock(recorder_t* rec, int clock)
+{
+    put_varint(rec, clock < 0 ? 0 : (unsigned long long)clock + 1);
+}
+
+static void
+put_rating(recorder_t* rec, const char* rating)
+{
+    int value = atoi(rating);
+    put_varint(rec, value < 0 ? 0 : (unsigned long long)value);
+}
+
+static void
+put_u64(recorder_t* rec, unsigned long long value)
+{
+    for (int i = 0; i < 8; i++)
+        put_byte(rec, (int)(value >> (8 * i)) & 0xff);
+}
+
+static void
+reserve(recorder_t* rec, size_t len)
+{
+    if (rec->len + len > sizeof(rec->buf))
+        record_flush(rec);
+}
+
+static size_t
+offset(const recorder_t* rec)
+{
+    return rec->base + rec->written + rec->len;
+}
+
+/* Starts a record, flushing first if it might not fit, and returns
+ * its offset in the file.
+ */
+static size_t
+begin(recorder_t* rec, int tag)
+{
+    reserve(rec, RECORD_MAX_ENCODED);
+    size_t start    = offset(rec);
+    long long now   = now_ms();
+    long long delta = now - rec->last_ms;
+    put_byte(rec, tag);
+    put_varint(rec, delta < 0 ? 0 : (unsigned long long)delta);
+    rec->last_ms = delta < 0 ? rec->last_ms : now;
+    return start;
+}
+
+static int
+intern_player(recorder_t* rec, const player_t* player)
+{
+    int added;
+    int id = intern_add(&rec->players, player->name, player->title, &added);
+    if (!added)
+        return id;
+    rec->player_offsets[id] = begin(rec, RECORD_PLAYER);
+    put_varint(rec, id);
+    put_string(rec, player->name);
+    put_string(rec, player->title);
+    return id;
+}
+
+static int
+index_add(record_index_t* index, record_game_t game)
+{
+    if (index->count == index->capacity) {
+        size_t capacity = index->capacity ? index->capacity * 2 : 64;
+        record_game_t* games =
+          memstat_realloc(index->games, capacity * sizeof(*games));
+        if (games == NULL)
+            return -1;
+        index->games    = games;
+        index->capacity = capacity;
+    }
+    index->games[index->count++] = game;
+    return 0;
+}
+
+static void
+record_game(recorder_t* rec, const frame_t* frame)
+{
+    int white = 0, black = 0;
+    record_game_t game = { 0, 0, 0 };
+    if (frame->has_players) {
+        white      = intern_player(rec, &frame->players[0]);
+        game.white = rec->player_offsets[white];
+        black      = intern_player(rec, &frame->players[1]);
+        game.black = rec->player_offsets[black];
+    }
+    game.offset = begin(rec, RECORD_GAME);
+    if (rec->sink == NULL)
+        index_add(&rec->index, game);
+    put_byte(rec, frame->channel);
+    put_string(rec, frame->id);
+    put_varint(rec, white);
+    put_varint(rec, black);
+    put_rating(rec, frame->has_players ? frame->players[0].rating : "");
+    put_rating(rec, frame->has_players ? frame->players[1].rating : "");
+    put_string(rec, frame->fen);
+    if (pos_from_fen(&rec->pos[frame->channel], frame->fen) != 0)
+        memset(rec->pos[frame->channel].mailbox, '.', BOARD_SIZE);
+}
+
+/* Stores the frame as a move when replaying the move gives back the
+ * same FEN text, otherwise as the FEN itself.
+ */
+static void
+record_move(recorder_t* rec, const frame_t* frame)
+{
+    position_t* pos = &rec->pos[frame->channel];
+    int move        = frame->lm[0] ? pos_pack_move(frame->lm) : -1;
+    if (move >= 0) {
+        position_t next = *pos;
+        char fen[FRAME_FEN_MAX];
+        if (pos_apply_uci(&next, frame->lm) == 0 &&
+            pos_to_fen(&next, fen, sizeof(fen)) >= 0 &&
+            !strcmp(fen, frame->fen)) {
+            *pos = next;
+            begin(rec, RECORD_MOVE);
+            put_byte(rec, frame->channel);
+            put_byte(rec, move & 0xff);
+            put_byte(rec, move >> 8);
+            put_clock(rec, frame->wc);
+            put_clock(rec, frame->bc);
+            return;
+        }
+    }
+
+    begin(rec, RECORD_FEN);
+    put_byte(rec, frame->channel);
+    put_string(rec, frame->fen);
+    put_string(rec, frame->lm);
+    put_clock(rec, frame->wc);
+    put_clock(rec, frame->bc);
+    if (pos_from_fen(pos, frame->fen) != 0)
+        memset(pos->mailbox, '.', BOARD_SIZE);
+}
+
+static int
+load_index(
+  const unsigned char* data,
+  size_t size,
+  record_index_t* index,
+  size_t* end
+);
+
+/* Picks up the index of the games already in the file so that the
+ * one written on close covers all of them. A session that was cut off
+ * mid record is truncated after its last whole one, since readers stop
+ * at the first record they cannot read and would never get past it to
+ * this one.
+ */
+static int
+load_existing(recorder_t* rec, size_t size)
+{
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, rec->fd, 0);
+    if (map == MAP_FAILED)
+        return -1;
+    size_t end = size;
+    int result = load_index(map, size, &rec->index, &end);
+    munmap(map, size);
+    if (result == 0 && end < size && ftruncate(rec->fd, (off_t)end) != 0)
+        return -1;
+    rec->base = end;
+    return result;
+}
+
+static void
+reset(recorder_t* rec)
+{
+    memset(rec, 0, sizeof(*rec));
+    for (int i = 0; i < FEED_MAX_CHANNELS; i++) {
+        memset(rec->pos[i].mailbox, '.', BOARD_SIZE);
+        rec->pos[i].ep = -1;
+    }
+    intern_init(&rec->players);
+}
+
+static void
+put_header(recorder_t* rec)
+{
+    memcpy(rec->buf + rec->len, RECORD_MAGIC, 4);
+    rec->len += 4;
+    put_byte(rec, RECORD_VERSION);
+}
+
+static void
+set_channels(recorder_t* rec, const char** names, int count)
+{
+    rec->index.channels = count < FEED_MAX_CHANNELS ? count : FEED_MAX_CHANNELS;
+    for (int i = 0; i < rec->index.channels; i++)
+        snprintf(rec->index.names[i], RECORD_NAME_MAX, "%s", names[i]);
+}
+
+// starts a RECORD_INDEX up to its game count
+static size_t
+begin_index(recorder_t* rec)
+{
+    record_index_t* index = &rec->index;
+    size_t at             = begin(rec, RECORD_INDEX);
+    put_varint(rec, index->channels);
+    // all the names together are more than begin reserves
+    for (int i = 0; i < index->channels; i++) {
+        reserve(rec, 1 + RECORD_NAME_MAX);
+        put_string(rec, index->names[i]);
+    }
+    return at;
+}
+
+int
+record_open(recorder_t* rec, const char* path, const char** names, int count)
+{
+    reset(rec);
+
+    rec->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (rec->fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(rec->fd, &st) != 0) {
+        close(rec->fd);
+        return -1;
+    }
+    rec->base = (size_t)st.st_size;
+    if (rec->base != 0 && load_existing(rec, rec->base) != 0) {
+        record_index_free(&rec->index);
+        close(rec->fd);
+        errno = EINVAL;
+        return -1;
+    }
+    if (rec->base == 0)
+        put_header(rec);
+
+    rec->last_ms    = now_ms();
+    rec->flushed_ms = rec->last_ms;
+    put_byte(rec, RECORD_CLOCK);
+    put_varint(rec, (unsigned long long)rec->last_ms);
+
+    set_channels(rec, names, count);
+    for (int i = 0; i < rec->index.channels; i++) {
+        begin(rec, RECORD_CHANNEL);
+        put_byte(rec, i);
+        put_string(rec, rec->index.names[i]);
+    }
+    return 0;
+}
+
+/* Encodes a live stream instead of a file, handing every flushed batch
+ * to the sink. Nothing is written until the first frame; a stream
+ * starts with record_snapshot on a recorder of its own.
+ */
+void
+record_stream(
+  recorder_t* rec,
+  const char** names,
+  int count,
+  record_sink_t(sink),
+  void* sink_data
+)
+{
+    reset(rec);
+    rec->fd         = -1;
+    rec->sink       = sink;
+    rec->sink_data  = sink_data;
+    rec->last_ms    = now_ms();
+    rec->flushed_ms = rec->last_ms;
+    set_channels(rec, names, count);
+}
+
+/* Writes the start of a stream from what a decoder reading it so far
+ * has seen, under the same player ids, so that a reader joining here
+ * decodes the rest exactly like one that was there from the start.
+ */
+void
+record_snapshot(recorder_t* rec, const record_decoder_t* dec)
+{
+    put_header(rec);
+    begin_index(rec);
+    put_varint(rec, 0);
+    for (int id = 1; id <= RECORD_MAX_PLAYERS; id++) {
+        const record_player_t* p = &dec->players[id];
+        if (p->name[0] == '\0' && p->title[0] == '\0')
+            continue;
+        begin(rec, RECORD_PLAYER);
+        put_varint(rec, id);
+        put_string(rec, p->name);
+        put_string(rec, p->title);
+    }
+
+    for (int i = 0; i < FEED_MAX_CHANNELS; i++) {
+        const record_t* game = &dec->games[i];
+        if (game->tag == RECORD_GAME) {
+            begin(rec, RECORD_GAME);
+            put_byte(rec, i);
+            put_string(rec, game->id);
+            put_varint(rec, game->white);
+            put_varint(rec, game->black);
+            put_varint(rec, game->ratings[0]);
+            put_varint(rec, game->ratings[1]);
+            put_string(rec, game->fen);
+        }
+        char fen[FRAME_FEN_MAX];
+        if (!dec->synced[i] ||
+            pos_to_fen(&dec->positions[i], fen, sizeof(fen)) < 0)
+            continue;
+        begin(rec, RECORD_FEN);
+        put_byte(rec, i);
+        put_string(rec, fen);
+        put_string(rec, dec->lm[i]);
+        put_clock(rec, dec->clocks[i][0]);
+        put_clock(rec, dec->clocks[i][1]);
+    }
+}
+
+void
+record_frame(recorder_t* rec, const frame_t* frame)
+{
+    if (rec->failed || frame->channel < 0 ||
+        frame->channel >= FEED_MAX_CHANNELS)
+        return;
+    if (frame->type == FRAME_FEATURED)
+        record_game(rec, frame);
+    else if (frame->type == FRAME_FEN)
+        record_move(rec, frame);
+}
+
+/* Called once per batch of feed data. */
+void
+record_tick(recorder_t* rec)
+{
+    if (rec->len >= sizeof(rec->buf) / 2 ||
+        (rec->len && now_ms() - rec->flushed_ms >= RECORD_FLUSH_MS))
+        record_flush(rec);
+}
+
+int
+record_flush(recorder_t* rec)
+{
+    size_t done = 0;
+    if (rec->sink != NULL && rec->len > 0) {
+        rec->sink(rec->sink_data, rec->buf, rec->len);
+        done = rec->len;
+    }
+    while (!rec->failed && done < rec->len) {
+        ssize_t n = write(rec->fd, rec->buf + done, rec->len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            rec->failed = 1;
+        else
+            done += (size_t)n;
+    }
+    rec->written += done;
+
+    rec->len        = 0;
+    rec->flushed_ms = now_ms();
+    return rec->failed ? -1 : 0;
+}
+
+static void
+write_index(recorder_t* rec)
+{
+    record_index_t* index = &rec->index;
+    size_t at             = begin_index(rec);
+    put_varint(rec, index->count);
+    for (size_t i = 0; i < index->count; i++) {
+        reserve(rec, 32);
+        put_varint(rec, index->games[i].offset);
+        put_varint(rec, index->games[i].white);
+        put_varint(rec, index->games[i].black);
+    }
+
+    reserve(rec, RECORD_FOOTER_SIZE);
+    put_byte(rec, RECORD_FOOTER);
+    put_byte(rec, 0);
+    put_u64(rec, at);
+    memcpy(rec->buf + rec->len, RECORD_TRAILER, 4);
+    rec->len += 4;
+}
+
+int
+record_close(recorder_t* rec)
+{
+    intern_destroy(&rec->players);
+    if (rec->sink != NULL) {
+        record_flush(rec);
+        return 0;
+    }
+    if (!rec->failed)
+        write_index(rec);
+    record_flush(rec);
+    if (close(rec->fd) != 0)
+        rec->failed = 1;
+    record_index_free(&rec->index);
+    return rec->failed ? -1 : 0;
+}
+
+typedef struct
+{
+    const unsigned char* p;
+    const unsigned char* end;
+} cursor_t;
+
+static int
+get_byte(cursor_t* c, int* value)
+{
+    if (c->p == c->end)
+        return -1;
+    *value = *c->p++;
+    return 0;
+}
+
+static int
+get_varint(cursor_t* c, unsigned long long* value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (c->p == c->end)
+            return -1;
+        int byte = *c->p++;
+        *value |= (unsigned long long)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return 0;
+    }
+    return -1;
+}
+
+static int
+get_int(cursor_t* c, int* value)
+{
+    unsigned long long v;
+    if (get_varint(c, &v) != 0 || v > INT_MAX)
+        return -1;
+    *value = (int)v;
+    return 0;
+}
+
+static int
+get_size(cursor_t* c, size_t* value)
+{
+    unsigned long long v;
+    if (get_varint(c, &v) != 0 || v > SIZE_MAX)
+        return -1;
+    *value = (size_t)v;
+    return 0;
+}
+
+// copies a string, failing if it would not fit with its terminator
+static int
+get_string(cursor_t* c, char* dst, size_t size)
+{
+    size_t len;
+    if (get_size(c, &len) != 0 || len >= size ||
+        len > (size_t)(c->end - c->p))
+        return -1;
+    memcpy(dst, c->p, len);
+    dst[len] = '\0';
+    c->p += len;
+    return 0;
+}
+
+static int
+get_clock(cursor_t* c, int* clock)
+{
+    if (get_int(c, clock) != 0)
+        return -1;
+    (*clock)--;
+    return 0;
+}
+
+static int
+get_channel(cursor_t* c, int* channel)
+{
+    return get_byte(c, channel) != 0 || *channel >= FEED_MAX_CHANNELS ? -1 : 0;
+}
+
+static int
+read_body(cursor_t* c, record_t* r)
+{
+    int lo, hi;
+    size_t skip;
+    switch (r->tag) {
+        case RECORD_CLOCK:
+            return 0;
+        case RECORD_CHANNEL:
+            return get_channel(c, &r->channel) ||
+                   get_string(c, r->name, sizeof(r->name));
+        case RECORD_PLAYER:
+            if (get_int(c, &r->player) || r->player < 1 ||
+                r->player > RECORD_MAX_PLAYERS)
+                return -1;
+            return get_string(c, r->name, PLAYER_NAME_MAX) ||
+                   get_string(c, r->title, sizeof(r->title));
+        case RECORD_GAME:
+            return get_channel(c, &r->channel) ||
+                   get_string(c, r->id, sizeof(r->id)) ||
+                   get_int(c, &r->white) || get_int(c, &r->black) ||
+                   get_int(c, &r->ratings[0]) || get_int(c, &r->ratings[1]) ||
+                   get_string(c, r->fen, sizeof(r->fen));
+        case RECORD_MOVE:
+            if (get_channel(c, &r->channel) || get_byte(c, &lo) ||
+                get_byte(c, &hi))
+                return -1;
+            r->move = lo | hi << 8;
+            return get_clock(c, &r->wc) || get_clock(c, &r->bc);
+        case RECORD_FEN:
+            return get_channel(c, &r->channel) ||
+                   get_string(c, r->fen, sizeof(r->fen)) ||
+                   get_string(c, r->lm, sizeof(r->lm)) ||
+                   get_clock(c, &r->wc) || get_clock(c, &r->bc);
+        case RECORD_INDEX:
+            if (get_int(c, &r->channel) || r->channel > FEED_MAX_CHANNELS)
+                return -1;
+            for (int i = 0; i < r->channel; i++) {
+                if (get_size(c, &skip) || skip > (size_t)(c->end - c->p))
+                    return -1;
+                c->p += skip;
+            }
+            // every entry takes at least three bytes
+            if (get_size(c, &r->index) ||
+                r->index > (size_t)(c->end - c->p) / 3)
+                return -1;
+            r->body = c->p;
+            for (size_t i = 0; i < r->index * 3; i++) {
+                unsigned long long offset;
+                if (get_varint(c, &offset))
+                    return -1;
+            }
+            r->body_len = (size_t)(c->p - r->body);
+            return 0;
+        case RECORD_FOOTER:
+            if (c->end - c->p < RECORD_FOOTER_SIZE - 2)
+                return -1;
+            r->index = 0;
+            for (int i = 0; i < 8; i++)
+                r->index |= (size_t)c->p[i] << (8 * i);
+            if (memcmp(c->p + 8, RECORD_TRAILER, 4) != 0)
+                return -1;
+            c->p += RECORD_FOOTER_SIZE - 2;
+            return 0;
+    }
+    return -1;
+}
+
+/* Decodes the record at *at and moves past it. Returns 1 for a record,
+ * 0 at the end of the data and -1 for anything malformed or cut off.
+ */
+int
+record_read(const unsigned char* data, size_t size, size_t* at, record_t* r)
+{
+    if (*at >= size)
+        return 0;
+    cursor_t c = { data + *at, data + size };
+    r->offset  = *at;
+    r->channel = 0;
+    if (get_byte(&c, &r->tag) || get_varint(&c, &r->time) ||
+        read_body(&c, r))
+        return -1;
+    *at = (size_t)(c.p - data);
+    return 1;
+}
+
+/* Fills in the channels of index from a RECORD_INDEX. Names too long
+ * for the index are left empty.
+ */
+int
+record_read_channels(
+  const unsigned char* data,
+  const record_t* r,
+  record_index_t* index
+)
+{
+    if (r->tag != RECORD_INDEX)
+        return -1;
+    // the names come right after the tag, time and channel count
+    cursor_t c = { data + r->offset, r->body };
+    int tag, channels;
+    unsigned long long time;
+    if (get_byte(&c, &tag) || get_varint(&c, &time) || get_int(&c, &channels))
+        return -1;
+    index->channels = channels;
+    for (int i = 0; i < channels; i++) {
+        if (get_string(&c, index->names[i], RECORD_NAME_MAX) != 0)
+            index->names[i][0] = '\0';
+    }
+    return 0;
+}
+
+void
+record_decoder_reset(record_decoder_t* dec)
+{
+    memset(dec, 0, sizeof(*dec));
+}
+
+// remembers the player a RECORD_PLAYER defines
+void
+record_decoder_define(record_decoder_t* dec, const record_t* r)
+{
+    record_player_t* player = &dec->players[r->player];
+    memcpy(player->name, r->name, sizeof(player->name));
+    memcpy(player->title, r->title, sizeof(player->title));
+}
+
+static void
+set_player(
+  const record_decoder_t* dec,
+  player_t* player,
+  int id,
+  int rating
+)
+{
+    if (id > 0 && id <= RECORD_MAX_PLAYERS) {
+        memcpy(player->name, dec->players[id].name, sizeof(player->name));
+        memcpy(player->title, dec->players[id].title, sizeof(player->title));
+    }
+    if (rating > 0 && rating < 100000)
+        snprintf(player->rating, sizeof(player->rating), "%d", rating);
+}
+
+/* Turns a record into a frame, defining players on the way. Returns 0
+ * for records that do not produce one, including moves on a channel
+ * that has not seen a full position yet.
+ */
+int
+record_decode(record_decoder_t* dec, const record_t* r, frame_t* frame)
+{
+    if (r->tag == RECORD_PLAYER)
+        record_decoder_define(dec, r);
+    if (r->tag != RECORD_GAME && r->tag != RECORD_FEN && r->tag != RECORD_MOVE)
+        return 0;
+    position_t* pos = &dec->positions[r->channel];
+    int* synced     = &dec->synced[r->channel];
+    frame_clear(frame);
+    frame->channel = r->channel;
+    switch (r->tag) {
+        case RECORD_GAME:
+            frame->type        = FRAME_FEATURED;
+            frame->has_players = r->white || r->black;
+            memset(frame->players, 0, sizeof(frame->players));
+            frame->players[1].is_black = 1;
+            set_player(dec, &frame->players[0], r->white, r->ratings[0]);
+            set_player(dec, &frame->players[1], r->black, r->ratings[1]);
+            memcpy(frame->id, r->id, sizeof(frame->id));
+            memcpy(frame->fen, r->fen, sizeof(frame->fen));
+            *synced                = pos_from_fen(pos, r->fen) == 0;
+            dec->games[r->channel] = *r;
+            break;
+        case RECORD_FEN:
+            frame->type = FRAME_FEN;
+            memcpy(frame->fen, r->fen, sizeof(frame->fen));
+            memcpy(frame->lm, r->lm, sizeof(frame->lm));
+            frame->wc = r->wc;
+            frame->bc = r->bc;
+            *synced   = pos_from_fen(pos, r->fen) == 0;
+            break;
+        case RECORD_MOVE:
+            if (!*synced || pos_unpack_move(r->move, frame->lm) != 0 ||
+                pos_apply_uci(pos, frame->lm) != 0 ||
+                pos_to_fen(pos, frame->fen, sizeof(frame->fen)) < 0) {
+                *synced = 0;
+                return 0;
+            }
+            frame->type = FRAME_FEN;
+            frame->wc   = r->wc;
+            frame->bc   = r->bc;
+            break;
+    }
+    memcpy(dec->lm[r->channel], frame->lm, FRAME_LM_MAX);
+    dec->clocks[r->channel][0] = frame->wc;
+    dec->clocks[r->channel][1] = frame->bc;
+    return 1;
+}
+
+static int
+load_footer(const unsigned char* data, size_t size, record_index_t* index)
+{
+    record_t r;
+    size_t at = size - RECORD_FOOTER_SIZE;
+    if (record_read(data, size, &at, &r) != 1 || r.tag != RECORD_FOOTER)
+        return -1;
+    at = r.index;
+    if (at < RECORD_HEADER_SIZE || record_read(data, size, &at, &r) != 1 ||
+        r.tag != RECORD_INDEX)
+        return -1;
+
+    record_read_channels(data, &r, index);
+    cursor_t c = { r.body, r.body + r.body_len };
+    for (size_t i = 0; i < r.index; i++) {
+        size_t offset, white, black;
+        get_size(&c, &offset);
+        get_size(&c, &white);
+        get_size(&c, &black);
+        if (offset >= size || white >= size || black >= size)
+            return -1;
+        record_game_t game = { offset, white, black };
+        if (index_add(index, game) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* Reads the whole file, stopping quietly at a record that was cut off
+ * when the recording process died.
+ */
+// end is where the last whole record ends
+static int
+scan_index(
+  const unsigned char* data,
+  size_t size,
+  record_index_t* index,
+  size_t* end
+)
+{
+    static size_t players[RECORD_MAX_PLAYERS + 1];
+    memset(players, 0, sizeof(players));
+    record_t r;
+    size_t at = RECORD_HEADER_SIZE;
+    while (record_read(data, size, &at, &r) == 1) {
+        if (r.tag == RECORD_CHANNEL) {
+            snprintf(index->names[r.channel], RECORD_NAME_MAX, "%s", r.name);
+            if (r.channel >= index->channels)
+                index->channels = r.channel + 1;
+        } else if (r.tag == RECORD_PLAYER) {
+            players[r.player] = r.offset;
+        } else if (r.tag == RECORD_GAME) {
+            record_game_t game = { r.offset, 0, 0 };
+            if (r.white > 0 && r.white <= RECORD_MAX_PLAYERS)
+                game.white = players[r.white];
+            if (r.black > 0 && r.black <= RECORD_MAX_PLAYERS)
+                game.black = players[r.black];
+            if (index_add(index, game) != 0)
+                return -1;
+        }
+    }
+    *end = at;
+    return 0;
+}
+
+static int
+load_index(
+  const unsigned char* data,
+  size_t size,
+  record_index_t* index,
+  size_t* end
+)
+{
+    *end = size;
+    memset(index, 0, sizeof(*index));
+    if (size < RECORD_HEADER_SIZE || memcmp(data, RECORD_MAGIC, 4) != 0 ||
+        data[4] != RECORD_VERSION)
+        return -1;
+    if (size >= RECORD_HEADER_SIZE + RECORD_FOOTER_SIZE &&
+        memcmp(data + size - 4, RECORD_TRAILER, 4) == 0 &&
+        load_footer(data, size, index) == 0)
+        return 0;
+    record_index_free(index);
+    return scan_index(data, size, index, end);
+}
+
+int
+record_load_index(const unsigned char* data, size_t size, record_index_t* index)
+{
+    size_t end;
+    return load_index(data, size, index, &end);
+}
+
+void
+record_index_free(record_index_t* index)
+{
+    memstat_free(index->games);
+    index->games    = NULL;
+    index->count    = 0;
+    index->capacity = 0;
+}
@@ -0,0 +1,208 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "frame.h"
+#include "feed.h"
+#include "intern.h"
+#include "position.h"
+
+/* Recording format. A file starts with RECORD_MAGIC and a version
+ * byte, followed by records. Every record is a tag byte and a varint
+ * time, then a body that depends on the tag:
+ *
+ *   RECORD_CLOCK   time is wall clock milliseconds since the epoch
+ *   RECORD_CHANNEL u8 channel, str name
+ *   RECORD_PLAYER  varint id, str name, str title
+ *   RECORD_GAME    u8 channel, str id, varint white, varint black,
+ *                  varint white rating, varint black rating, str fen
+ *   RECORD_MOVE    u8 channel, u16 move (see pos_pack_move), varint wc+1,
+ *                  varint bc+1
+ *   RECORD_FEN     u8 channel, str fen, str lm, varint wc+1, varint bc+1
+ *   RECORD_INDEX   varint channels, str name per channel, varint games,
+ *                  then per game varint offsets of the RECORD_GAME and
+ *                  of the RECORD_PLAYER for white and black (0 if none)
+ *   RECORD_FOOTER  u64 offset of the RECORD_INDEX, then RECORD_TRAILER
+ *
+ * For everything but RECORD_CLOCK the time is milliseconds since the
+ * previous record. Integers are unsigned LEB128, u16 and u64 are
+ * little endian, str is a varint length and the bytes. A RECORD_MOVE
+ * is written when applying the move reproduces the feed's FEN exactly,
+ * otherwise the frame is stored with RECORD_FEN. Player ids are only
+ * meaningful after the RECORD_PLAYER that defines them; an id may be
+ * redefined.
+ *
+ * A live stream, as sent by --serve, opens with a snapshot: the header,
+ * a RECORD_INDEX with the channels and no games, every player defined
+ * so far, and for each channel its RECORD_GAME and a RECORD_FEN of the
+ * current position. Records as above follow.
+ *
+ * Opening an existing file appends a new session that starts with a
+ * RECORD_CLOCK and the session's channels. A clean close ends the
+ * session with an index of every game in the file and a fixed size
+ * footer, so a reader can find any game from the end of the file.
+ * Without a footer the index is rebuilt by reading the whole file.
+ */
+#define RECORD_MAGIC   "LITV"
+#define RECORD_VERSION 1
+#define RECORD_TRAILER "LIDX"
+
+#define RECORD_CLOCK   1
+#define RECORD_PLAYER  2
+#define RECORD_GAME    3
+#define RECORD_MOVE    4
+#define RECORD_FEN     5
+#define RECORD_CHANNEL 6
+#define RECORD_INDEX   7
+#define RECORD_FOOTER  8
+
+#define RECORD_HEADER_SIZE 5
+#define RECORD_FOOTER_SIZE 14
+#define RECORD_MAX_PLAYERS INTERN_MAX
+#define RECORD_BUFFER_SIZE 65536
+#define RECORD_NAME_MAX    32
+// longest record but RECORD_INDEX
+#define RECORD_MAX_ENCODED 512
+
+typedef struct
+{
+    char name[PLAYER_NAME_MAX];
+    char title[PLAYER_TITLE_MAX];
+    size_t offset;
+} record_player_t;
+
+// file offsets of a game and of the records defining its players
+typedef struct
+{
+    size_t offset;
+    size_t white;
+    size_t black;
+} record_game_t;
+
+typedef struct
+{
+    record_game_t* games;
+    size_t count;
+    size_t capacity;
+    int channels;
+    char names[FEED_MAX_CHANNELS][RECORD_NAME_MAX];
+} record_index_t;
+
+/* One record as read back from a file. Only the fields of its tag are
+ * filled in; for RECORD_INDEX, body points at the encoded entries.
+ */
+typedef struct
+{
+    int tag;
+    size_t offset;
+    unsigned long long time;
+    int channel;
+    int player;
+    char name[RECORD_NAME_MAX];
+    char title[PLAYER_TITLE_MAX];
+    char id[FRAME_ID_MAX];
+    int white;
+    int black;
+    int ratings[2];
+    char fen[FRAME_FEN_MAX];
+    char lm[FRAME_LM_MAX];
+    int move;
+    int wc;
+    int bc;
+    size_t index;
+    const unsigned char* body;
+    size_t body_len;
+} record_t;
+
+#define record_sink_t(fn) void (*fn)(void*, const unsigned char*, size_t)
+
+/* Players and positions seen so far while reading records back, so
+ * moves can be expanded into full frames, and each channel's last game
+ * and clocks, so a stream can be snapshot.
+ */
+typedef struct
+{
+    record_player_t players[RECORD_MAX_PLAYERS + 1];
+    position_t positions[FEED_MAX_CHANNELS];
+    int synced[FEED_MAX_CHANNELS];
+    record_t games[FEED_MAX_CHANNELS];
+    char lm[FEED_MAX_CHANNELS][FRAME_LM_MAX];
+    int clocks[FEED_MAX_CHANNELS][2];
+} record_decoder_t;
+
+/* Writes to fd when recording to a file, or hands every flushed batch
+ * to sink when encoding a stream.
+ */
+typedef struct
+{
+    int fd;
+    record_sink_t(sink);
+    void* sink_data;
+    unsigned char buf[RECORD_BUFFER_SIZE];
+    size_t len;
+    size_t base;
+    long long last_ms;
+    long long flushed_ms;
+    size_t written;
+    int failed;
+    position_t pos[FEED_MAX_CHANNELS];
+    intern_t players;
+    // offset of the RECORD_PLAYER defining each id
+    size_t player_offsets[RECORD_MAX_PLAYERS + 1];
+    record_index_t index;
+} recorder_t;
+
+int
+record_open(recorder_t* rec, const char* path, const char** names, int count);
+
+void
+record_stream(
+  recorder_t* rec,
+  const char** names,
+  int count,
+  record_sink_t(sink),
+  void* sink_data
+);
+
+void
+record_snapshot(recorder_t* rec, const record_decoder_t* dec);
+
+void
+record_frame(recorder_t* rec, const frame_t* frame);
+
+void
+record_tick(recorder_t* rec);
+
+int
+record_flush(recorder_t* rec);
+
+int
+record_close(recorder_t* rec);
+
+int
+record_read(const unsigned char* data, size_t size, size_t* at, record_t* r);
+
+int
+record_read_channels(
+  const unsigned char* data,
+  const record_t* r,
+  record_index_t* index
+);
+
+void
+record_decoder_reset(record_decoder_t* dec);
+
+void
+record_decoder_define(record_decoder_t* dec, const record_t* r);
+
+int
+record_decode(record_decoder_t* dec, const record_t* r, frame_t* frame);
+
+int
+record_load_index(const unsigned char* data, size_t size, record_index_t* index);
+
+void
+record_index_free(record_index_t* index);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "game.h"
+
+#define RENDER_MAX_BOARDS 16
+#define RENDER_NO_KEY     (-1)
+
+// keys other than characters, as returned by key
+#define RENDER_KEY_LEFT      0x101
+#define RENDER_KEY_RIGHT     0x102
+#define RENDER_KEY_PAGE_UP   0x103
+#define RENDER_KEY_PAGE_DOWN 0x104
+#define RENDER_KEY_HOME      0x105
+#define RENDER_KEY_END       0x106
+
+/* A way of showing games. draw is called for each board that changed,
+ * with the GAME_*_CHANGED flags, and flush once per scheduler tick.
+ * resize is called after the terminal changed size, and is followed by
+ * a draw of every board. overlay, key and resize are NULL for backends
+ * without a screen or input.
+ */
+typedef struct
+{
+    const char* name;
+    int (*init)(int boards, const char** labels);
+    void (*draw)(int board, const game_t* game, int changed);
+    void (*flush)();
+    void (*overlay)(const char* text);
+    int (*key)();
+    void (*resize)();
+    void (*destroy)();
+} render_t;
+
+extern const render_t render_curses;
+extern const render_t render_headless;
+
+#endif
@@ -0,0 +1,208 @@
+/* Replay
+ *
+ * Plays a recording back through the same frame callback the live
+ * feed uses, so everything past decoding cannot tell the difference.
+ * The file is mapped rather than read, and records are decoded in
+ * place.
+ *
+ * Time between records is scaled by the speed and slept off against
+ * an absolute deadline, so rounding does not add up over a long file.
+ * A speed of 0 plays as fast as the consumer keeps up. The sleeps are
+ * polls on an eventfd, so replay_stop ends a replay without waiting
+ * out the gap to the next record.
+ *
+ * Starting at a game goes straight to its offset from the index, and
+ * loads the two player records the index points at. Moves on other
+ * channels are skipped until those channels see a full position.
+ */
+
+#define _GNU_SOURCE
+#include "replay.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REPLAY_FAST_BATCH 32
+
+static record_decoder_t decoder;
+
+int
+replay_open(replay_t* replay, const char* path)
+{
+    memset(replay, 0, sizeof(*replay));
+    replay->stop_fd = -1;
+    replay->fd      = open(path, O_RDONLY);
+    if (replay->fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(replay->fd, &st) != 0 || st.st_size == 0) {
+        close(replay->fd);
+        return -1;
+    }
+
+    replay->size = (size_t)st.st_size;
+    void* map =
+      mmap(NULL, replay->size, PROT_READ, MAP_PRIVATE, replay->fd, 0);
+    if (map == MAP_FAILED) {
+        close(replay->fd);
+        return -1;
+    }
+    replay->data    = map;
+    replay->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (replay->stop_fd < 0) {
+        replay_close(replay);
+        return -1;
+    }
+    madvise(map, replay->size, MADV_SEQUENTIAL);
+
+    if (record_load_index(replay->data, replay->size, &replay->index) != 0) {
+        replay_close(replay);
+        return -1;
+    }
+    if (replay->index.channels < 1)
+        replay->index.channels = 1;
+    return 0;
+}
+
+static void
+load_player(replay_t* replay, size_t offset)
+{
+    record_t r;
+    if (offset != 0 &&
+        record_read(replay->data, replay->size, &offset, &r) == 1 &&
+        r.tag == RECORD_PLAYER)
+        record_decoder_define(&decoder, &r);
+}
+
+static void
+add_ms(struct timespec* ts, double ms)
+{
+    long long ns = (long long)(ms * 1e6);
+    ts->tv_sec += ns / 1000000000LL;
+    ts->tv_nsec += ns % 1000000000LL;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+/* Sleeps until deadline. Returns -1 at once if replay_stop was called,
+ * before or during the sleep; a past deadline only checks for that.
+ */
+static int
+wait_until(const replay_t* replay, const struct timespec* deadline)
+{
+    struct pollfd pfd = { replay->stop_fd, POLLIN, 0 };
+    for (;;) {
+        struct timespec now, left;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        left.tv_sec  = deadline->tv_sec - now.tv_sec;
+        left.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+        if (left.tv_nsec < 0) {
+            left.tv_sec--;
+            left.tv_nsec += 1000000000L;
+        }
+        if (left.tv_sec < 0)
+            left.tv_sec = left.tv_nsec = 0;
+        int r = ppoll(&pfd, 1, &left, NULL);
+        if (r > 0)
+            return -1;
+        if (r == 0)
+            return 0;
+        if (errno != EINTR)
+            return 0;
+    }
+}
+
+/* Plays from the start of the file, or from the given game (counting
+ * from 1), until the end of the file or replay_stop. Returns the
+ * number of frames delivered, or -1 when there is no such game.
+ */
+int
+replay_run(
+  replay_t* replay,
+  size_t game,
+  double speed,
+  frame_callback_t(cb_ptr),
+  batch_callback_t(batch_ptr)
+)
+{
+    size_t at = RECORD_HEADER_SIZE;
+    record_decoder_reset(&decoder);
+    if (game > 0) {
+        if (game > replay->index.count)
+            return -1;
+        const record_game_t* entry = &replay->index.games[game - 1];
+        load_player(replay, entry->white);
+        load_player(replay, entry->black);
+        at = entry->offset;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    int frames = 0, unsent = 0;
+    record_t r;
+    while (record_read(replay->data, replay->size, &at, &r) == 1) {
+        if (r.tag == RECORD_PLAYER) {
+            record_decoder_define(&decoder, &r);
+            continue;
+        }
+
+        // a new session starts with absolute time, not a delay
+        if (speed > 0 && r.tag != RECORD_CLOCK && r.time > 0) {
+            if (unsent && batch_ptr)
+                batch_ptr();
+            unsent = 0;
+            add_ms(&deadline, (double)r.time / speed);
+            if (wait_until(replay, &deadline) != 0)
+                break;
+        }
+
+        frame_t frame;
+        if (!record_decode(&decoder, &r, &frame))
+            continue;
+        cb_ptr(&frame);
+        frames++;
+        if (++unsent == REPLAY_FAST_BATCH) {
+            if (batch_ptr)
+                batch_ptr();
+            unsent = 0;
+            // flat out never sleeps, so look for a stop between batches
+            if (speed <= 0 && wait_until(replay, &deadline) != 0)
+                break;
+        }
+    }
+    if (batch_ptr)
+        batch_ptr();
+    return frames;
+}
+
+/* Makes replay_run return. Safe from any thread. */
+void
+replay_stop(replay_t* replay)
+{
+    uint64_t one = 1;
+    ssize_t n    = write(replay->stop_fd, &one, sizeof(one));
+    (void)n;
+}
+
+void
+replay_close(replay_t* replay)
+{
+    record_index_free(&replay->index);
+    if (replay->data != NULL)
+        munmap((void*)replay->data, replay->size);
+    if (replay->stop_fd >= 0)
+        close(replay->stop_fd);
+    close(replay->fd);
+    replay->data    = NULL;
+    replay->stop_fd = -1;
+}
@@ -0,0 +1,37 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stddef.h>
+#include "feed.h"
+#include "frame.h"
+#include "record.h"
+
+typedef struct
+{
+    int fd;
+    const unsigned char* data;
+    size_t size;
+    record_index_t index;
+    // written by replay_stop
+    int stop_fd;
+} replay_t;
+
+int
+replay_open(replay_t* replay, const char* path);
+
+int
+replay_run(
+  replay_t* replay,
+  size_t game,
+  double speed,
+  frame_callback_t(cb_ptr),
+  batch_callback_t(batch_ptr)
+);
+
+void
+replay_stop(replay_t* replay);
+
+void
+replay_close(replay_t* replay);
+
+#endif
@@ -0,0 +1,86 @@
+/* Render Scheduler
+ *
+ * Frames mark the screen dirty as they arrive, but the screen is only
+ * flushed once per tick of the configured frame rate. A burst of
+ * moves inside one tick is drawn once, with the latest position.
+ *
+ * A frame that arrives after the screen has been idle for more than a
+ * tick goes out immediately, so the cap never delays a lone move.
+ */
+
+#include "sched.h"
+
+#define NS_PER_SEC 1000000000LL
+#define NS_PER_MS  1000000LL
+
+// long only holds about 2 s of nanoseconds on 32 bit targets
+static long long
+diff_ns(const struct timespec* a, const struct timespec* b)
+{
+    return (long long)(a->tv_sec - b->tv_sec) * NS_PER_SEC +
+           (a->tv_nsec - b->tv_nsec);
+}
+
+void
+sched_init(sched_t* sched, int fps)
+{
+    if (fps <= 0)
+        fps = SCHED_DEFAULT_FPS;
+    sched->interval_ns = NS_PER_SEC / fps;
+    sched->changed     = 0;
+    sched->received    = 0;
+    sched->drawn       = 0;
+    clock_gettime(CLOCK_MONOTONIC, &sched->next);
+}
+
+void
+sched_mark(sched_t* sched, int changed)
+{
+    sched->received++;
+    sched->changed |= changed;
+}
+
+// marks the screen dirty for something other than a frame
+void
+sched_redraw(sched_t* sched, int changed)
+{
+    sched->changed |= changed;
+}
+
+/* Milliseconds until the pending changes may be flushed, 0 if they
+ * can go now and -1 if there is nothing to draw.
+ */
+int
+sched_timeout(sched_t* sched)
+{
+    if (!sched->changed)
+        return -1;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long wait = diff_ns(&sched->next, &now);
+    if (wait <= 0)
+        return 0;
+    return (int)((wait + NS_PER_MS - 1) / NS_PER_MS);
+}
+
+/* Returns the layers to draw when a flush is due (or right away when
+ * force is set), and starts the next tick. Returns 0 when there is
+ * nothing to do yet.
+ */
+int
+sched_take(sched_t* sched, int force)
+{
+    if (!sched->changed || (!force && sched_timeout(sched) != 0))
+        return 0;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long next_ns   = now.tv_nsec + sched->interval_ns;
+    sched->next.tv_sec  = now.tv_sec + (time_t)(next_ns / NS_PER_SEC);
+    sched->next.tv_nsec = (long)(next_ns % NS_PER_SEC);
+
+    int changed    = sched->changed;
+    sched->changed = 0;
+    sched->drawn++;
+    return changed;
+}
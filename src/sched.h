@@ -0,0 +1,33 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stddef.h>
+#include <time.h>
+
+#define SCHED_DEFAULT_FPS 30
+
+typedef struct
+{
+    long long interval_ns;
+    struct timespec next;
+    int changed;
+    size_t received;
+    size_t drawn;
+} sched_t;
+
+void
+sched_init(sched_t* sched, int fps);
+
+void
+sched_mark(sched_t* sched, int changed);
+
+void
+sched_redraw(sched_t* sched, int changed);
+
+int
+sched_timeout(sched_t* sched);
+
+int
+sched_take(sched_t* sched, int force);
+
+#endif
@@ -0,0 +1,235 @@
+/* Search
+ *
+ * A small alpha-beta search for the evaluation bar: negamax over the
+ * legal moves, with a quiescence search over captures at the leaves so
+ * a piece left hanging is not counted as material. The caller deepens
+ * one ply at a time and passes the best move of the last depth back
+ * in, which is tried first; captures follow, most valuable victim
+ * first, then the two quiet moves that last caused a cutoff at the same
+ * ply. Positions are scored by material and a few square bonuses.
+ *
+ * Nothing is kept between calls and nothing is allocated, so any
+ * number of threads can search at once. The only thing shared is the
+ * generation counter a search watches to learn it is stale.
+ */
+
+#include "search.h"
+
+// how often the generation is looked at, in positions
+#define SEARCH_CHECK_EVERY 1024
+// captures searched past the nominal depth
+#define SEARCH_QUIESCE_PLIES 12
+
+// PNBRQK, in centipawns
+static const int VALUES[6] = { 100, 320, 330, 500, 900, 0 };
+// below any capture, above the other quiet moves
+#define SEARCH_KILLER_ORDER 1000
+
+// knights and bishops like the centre; the same for both sides
+static const signed char CENTRE[BOARD_SIZE] = {
+    -20, -10, -10, -10, -10, -10, -10, -20, -10, 0,   0,   0,   0,
+    0,   0,   -10, -10, 0,   10,  10,  10,  10,  0,   -10, -10, 5,
+    10,  20,  20,  10,  5,   -10, -10, 5,   10,  20,  20,  10,  5,
+    -10, -10, 0,   10,  10,  10,  10,  0,   -10, -10, 0,   0,   0,
+    0,   0,   0,   -10, -20, -10, -10, -10, -10, -10, -10, -20,
+};
+
+// pawns by rows still to go before promoting
+static const signed char PAWN_ADVANCE[8] = { 0, 60, 30, 15, 5, 0, 0, 0 };
+
+/* Material and square bonuses, from the side to move's point of view
+ * like every score in the search.
+ */
+int
+search_static(const position_t* pos)
+{
+    int score = 0;
+    for (int side = WHITE; side <= BLACK; side++) {
+        const uint64_t* own = &pos->pieces[side * 6];
+        int sign            = side == WHITE ? 1 : -1;
+        int total           = 0;
+        for (int kind = 0; kind < 5; kind++)
+            total += VALUES[kind] * __builtin_popcountll(own[kind]);
+        for (uint64_t bb = own[0]; bb; bb &= bb - 1) {
+            int row = __builtin_ctzll(bb) / 8;
+            total += PAWN_ADVANCE[side == WHITE ? row : 7 - row];
+        }
+        for (uint64_t bb = own[1] | own[2]; bb; bb &= bb - 1)
+            total += CENTRE[__builtin_ctzll(bb)];
+        score += sign * total;
+    }
+    return pos->side == WHITE ? score : -score;
+}
+
+static int
+stopped(search_t* search)
+{
+    if (search->aborted)
+        return 1;
+    if (++search->nodes >= search->max_nodes ||
+        (search->nodes % SEARCH_CHECK_EVERY == 0 &&
+         atomic_load_explicit(search->current, memory_order_relaxed) !=
+           search->generation))
+        search->aborted = 1;
+    return search->aborted;
+}
+
+static int
+piece_value(char piece)
+{
+    int index = pos_piece_index(piece);
+    return index < 0 ? 0 : VALUES[index % 6];
+}
+
+static int
+is_quiet(const position_t* pos, int move)
+{
+    return pos->mailbox[MOVE_TO(move)] == '.' && MOVE_PROMO(move) == 0;
+}
+
+static int
+order_score(
+  const position_t* pos,
+  int move,
+  int best,
+  const uint16_t* killers
+)
+{
+    if (move == best)
+        return 1 << 20;
+    if (killers != NULL && (move == killers[0] || move == killers[1]))
+        return SEARCH_KILLER_ORDER;
+    int score   = 0;
+    char victim = pos->mailbox[MOVE_TO(move)];
+    if (victim != '.')
+        score = piece_value(victim) * 16 -
+                piece_value(pos->mailbox[MOVE_FROM(move)]) / 16;
+    // promotions number NBRQ from 1, as VALUES does
+    if (MOVE_PROMO(move) > 0 && MOVE_PROMO(move) < 5)
+        score += VALUES[MOVE_PROMO(move)];
+    return score;
+}
+
+static void
+order(
+  const position_t* pos,
+  uint16_t* moves,
+  int count,
+  int best,
+  const uint16_t* killers
+)
+{
+    int scores[POS_MAX_MOVES];
+    for (int i = 0; i < count; i++)
+        scores[i] = order_score(pos, moves[i], best, killers);
+    // insertion sort: most lists are short and mostly quiet moves
+    for (int i = 1; i < count; i++) {
+        int score     = scores[i];
+        uint16_t move = moves[i];
+        int j         = i;
+        for (; j > 0 && scores[j - 1] < score; j--) {
+            scores[j] = scores[j - 1];
+            moves[j]  = moves[j - 1];
+        }
+        scores[j] = score;
+        moves[j]  = move;
+    }
+}
+
+static int
+quiesce(search_t* search, const position_t* pos, int alpha, int beta, int ply)
+{
+    if (stopped(search))
+        return 0;
+    int stand = search_static(pos);
+    if (stand >= beta || ply >= SEARCH_QUIESCE_PLIES)
+        return stand;
+    if (stand > alpha)
+        alpha = stand;
+
+    uint16_t moves[POS_MAX_MOVES];
+    int count = pos_moves(pos, moves, 1);
+    order(pos, moves, count, 0, NULL);
+    for (int i = 0; i < count; i++) {
+        position_t next = *pos;
+        pos_apply_move(&next, moves[i]);
+        int score = -quiesce(search, &next, -beta, -alpha, ply + 1);
+        if (search->aborted)
+            return 0;
+        if (score >= beta)
+            return score;
+        if (score > alpha)
+            alpha = score;
+    }
+    return alpha;
+}
+
+static int
+negamax(
+  search_t* search,
+  const position_t* pos,
+  int depth,
+  int alpha,
+  int beta,
+  int ply,
+  int* best
+)
+{
+    if (depth == 0)
+        return quiesce(search, pos, alpha, beta, 0);
+    if (stopped(search))
+        return 0;
+
+    uint16_t moves[POS_MAX_MOVES];
+    int count = pos_moves(pos, moves, 0);
+    if (count == 0)
+        return pos_in_check(pos, pos->side) ? -(SEARCH_MATE - ply) : 0;
+    uint16_t* killers = ply < SEARCH_MAX_DEPTH ? search->killers[ply] : NULL;
+    order(pos, moves, count, best != NULL ? *best : 0, killers);
+
+    for (int i = 0; i < count; i++) {
+        position_t next = *pos;
+        pos_apply_move(&next, moves[i]);
+        int score =
+          -negamax(search, &next, depth - 1, -beta, -alpha, ply + 1, NULL);
+        if (search->aborted)
+            return 0;
+        if (score > alpha) {
+            alpha = score;
+            if (best != NULL)
+                *best = moves[i];
+        }
+        if (alpha >= beta) {
+            if (killers != NULL && is_quiet(pos, moves[i]) &&
+                killers[0] != moves[i]) {
+                killers[1] = killers[0];
+                killers[0] = moves[i];
+            }
+            break;
+        }
+    }
+    return alpha;
+}
+
+/* Searches pos depth plies deep. best is the move to try first on the
+ * way in, 0 for none, and the best move found on the way out. Returns
+ * 0 with the score for the side to move, or -1 when the search was
+ * stopped before it finished, leaving score alone.
+ */
+int
+search_depth(
+  search_t* search,
+  const position_t* pos,
+  int depth,
+  int* score,
+  int* best
+)
+{
+    int move = *best;
+    int s = negamax(search, pos, depth, -SEARCH_MATE, SEARCH_MATE, 0, &move);
+    if (search->aborted)
+        return -1;
+    *score = s;
+    *best  = move;
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include "position.h"
+
+// mate in n plies scores SEARCH_MATE - n
+#define SEARCH_MATE      30000
+#define SEARCH_MAX_DEPTH 32
+
+/* One search. It gives up when *current stops being generation, which
+ * is how a newer position cancels it, or after max_nodes positions.
+ * Zero the rest before the first depth.
+ */
+typedef struct
+{
+    const atomic_uint* current;
+    unsigned generation;
+    size_t nodes;
+    size_t max_nodes;
+    int aborted;
+    // quiet moves that last cut the search off, by ply
+    uint16_t killers[SEARCH_MAX_DEPTH][2];
+} search_t;
+
+int
+search_depth(
+  search_t* search,
+  const position_t* pos,
+  int depth,
+  int* score,
+  int* best
+);
+
+int
+search_static(const position_t* pos);
+
+#endif
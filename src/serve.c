@@ -0,0 +1,432 @@
+/* Serving
+ *
+ * Rebroadcasts the frames of one upstream connection to any number of
+ * local litv clients, so a room full of screens costs lichess a single
+ * feed. Frames are encoded with the recording format, on the network
+ * thread, into one batch per feed callback; each batch becomes a
+ * reference counted buffer that every client is sent from, so a frame
+ * is encoded and copied once no matter how many clients there are.
+ *
+ * The sockets belong to a thread of their own running an epoll loop
+ * over the listener, an eventfd the network thread signals when it has
+ * queued batches, and the clients. Every client has a short queue of
+ * the buffers it still has to be sent and goes out with one gathering
+ * send per wakeup. A client whose socket is full waits for EPOLLOUT;
+ * one that falls SERVE_CLIENT_BACKLOG batches behind is dropped rather
+ * than allowed to hold memory the others have finished with.
+ *
+ * The server thread also decodes every batch it sends, so it always
+ * knows the players, games and positions the clients have been shown.
+ * A new client is first sent a snapshot of that state, and joins the
+ * live stream at the next batch with a full board and both players on
+ * screen. Batches always hold whole records, which makes every batch
+ * boundary a place a client can join.
+ */
+
+#define _GNU_SOURCE
+#include "serve.h"
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "memstat.h"
+#include "net.h"
+#include "record.h"
+#include "stats.h"
+
+#define SERVE_MAX_CLIENTS    64
+#define SERVE_CLIENT_BACKLOG 256
+#define SERVE_IOV_MAX        64
+#define SERVE_EVENTS         64
+#define SERVE_DRAIN_MS       2000
+
+// epoll tags; clients are tagged with their slot after these
+#define SERVE_LISTENER 0
+#define SERVE_WAKE     1
+#define SERVE_CLIENT   2
+
+typedef struct wire_buf_t
+{
+    struct wire_buf_t* next;
+    int refs;
+    size_t len;
+    unsigned char data[];
+} wire_buf_t;
+
+typedef struct
+{
+    int fd;
+    int writable_wait;
+    wire_buf_t* pending[SERVE_CLIENT_BACKLOG];
+    size_t head;
+    size_t count;
+    // bytes of the first pending buffer already sent
+    size_t sent;
+    // a piece of the snapshot could not be queued
+    int incomplete;
+} client_t;
+
+static recorder_t encoder;
+// on the server thread: the stream so far, and a new client's start
+static record_decoder_t shown;
+static recorder_t snapshot;
+static const char** channel_names;
+static int channel_count;
+// batches handed over by the network thread
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static wire_buf_t* outbox;
+static wire_buf_t** outbox_tail = &outbox;
+static int stopping;
+
+static pthread_t thread;
+static int listen_fd = -1;
+static int epoll_fd  = -1;
+static int wake_fd   = -1;
+static client_t clients[SERVE_MAX_CLIENTS];
+
+static void
+wake()
+{
+    uint64_t one = 1;
+    ssize_t r    = write(wake_fd, &one, sizeof(one));
+    (void)r;
+}
+
+static void
+unref(wire_buf_t* buf)
+{
+    if (--buf->refs == 0)
+        memstat_free(buf);
+}
+
+static wire_buf_t*
+wire_new(const unsigned char* bytes, size_t len)
+{
+    wire_buf_t* buf = memstat_malloc(sizeof(*buf) + len);
+    if (buf == NULL)
+        return NULL;
+    buf->next = NULL;
+    buf->refs = 1;
+    buf->len  = len;
+    memcpy(buf->data, bytes, len);
+    return buf;
+}
+
+// recorder sink, on the network thread
+static void
+sink(void* data, const unsigned char* bytes, size_t len)
+{
+    wire_buf_t* buf = wire_new(bytes, len);
+    if (buf == NULL)
+        return;
+    pthread_mutex_lock(&lock);
+    *outbox_tail = buf;
+    outbox_tail  = &buf->next;
+    pthread_mutex_unlock(&lock);
+    wake();
+}
+
+static void
+watch(client_t* client, int writable)
+{
+    if (client->writable_wait == writable)
+        return;
+    client->writable_wait = writable;
+    struct epoll_event ev = {
+        EPOLLIN | EPOLLRDHUP | (writable ? EPOLLOUT : 0),
+        { .u64 = SERVE_CLIENT + (uint64_t)(client - clients) },
+    };
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->fd, &ev);
+}
+
+static void
+drop(client_t* client)
+{
+    for (size_t i = 0; i < client->count; i++)
+        unref(client->pending[(client->head + i) % SERVE_CLIENT_BACKLOG]);
+    close(client->fd);
+    memset(client, 0, sizeof(*client));
+    client->fd = -1;
+}
+
+static int
+enqueue(client_t* client, wire_buf_t* buf)
+{
+    if (client->count == SERVE_CLIENT_BACKLOG)
+        return -1;
+    size_t slot = (client->head + client->count) % SERVE_CLIENT_BACKLOG;
+    buf->refs++;
+    client->pending[slot] = buf;
+    client->count++;
+    return 0;
+}
+
+// snapshot sink, queueing straight to the client being accepted
+static void
+snapshot_sink(void* data, const unsigned char* bytes, size_t len)
+{
+    client_t* client = data;
+    wire_buf_t* buf  = wire_new(bytes, len);
+    if (buf == NULL || enqueue(client, buf) != 0)
+        client->incomplete = 1;
+    if (buf != NULL)
+        unref(buf);
+}
+
+static void
+follow(const wire_buf_t* buf)
+{
+    size_t at = 0;
+    record_t r;
+    frame_t frame;
+    while (record_read(buf->data, buf->len, &at, &r) == 1)
+        record_decode(&shown, &r, &frame);
+}
+
+/* Sends as much of the client's queue as its socket takes. Returns -1
+ * when the client has gone away.
+ */
+static int
+send_pending(client_t* client)
+{
+    while (client->count > 0) {
+        struct iovec iov[SERVE_IOV_MAX];
+        int n = 0;
+        for (size_t i = 0; i < client->count && n < SERVE_IOV_MAX; i++) {
+            wire_buf_t* buf =
+              client->pending[(client->head + i) % SERVE_CLIENT_BACKLOG];
+            size_t skip     = i == 0 ? client->sent : 0;
+            iov[n].iov_base = buf->data + skip;
+            iov[n++].iov_len = buf->len - skip;
+        }
+        // a writev that cannot raise SIGPIPE
+        struct msghdr msg = { .msg_iov = iov, .msg_iovlen = (size_t)n };
+        ssize_t sent      = sendmsg(client->fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            watch(client, 1);
+            return 0;
+        }
+        if (sent < 0)
+            return -1;
+
+        client->sent += (size_t)sent;
+        while (client->count > 0) {
+            wire_buf_t* buf = client->pending[client->head];
+            if (client->sent < buf->len)
+                break;
+            client->sent -= buf->len;
+            unref(buf);
+            client->head = (client->head + 1) % SERVE_CLIENT_BACKLOG;
+            client->count--;
+        }
+    }
+    watch(client, 0);
+    return 0;
+}
+
+static void
+accept_clients()
+{
+    int fd;
+    while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)
+           ) >= 0) {
+        client_t* client = NULL;
+        for (int i = 0; i < SERVE_MAX_CLIENTS && client == NULL; i++) {
+            if (clients[i].fd < 0)
+                client = &clients[i];
+        }
+        if (client == NULL) {
+            close(fd);
+            continue;
+        }
+        struct epoll_event ev = {
+            EPOLLIN | EPOLLRDHUP,
+            { .u64 = SERVE_CLIENT + (uint64_t)(client - clients) },
+        };
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            continue;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        client->fd = fd;
+        record_stream(
+          &snapshot, channel_names, channel_count, snapshot_sink, client
+        );
+        record_snapshot(&snapshot, &shown);
+        record_flush(&snapshot);
+        // a gap would leave the client decoding against the wrong state
+        if (client->incomplete || send_pending(client) != 0)
+            drop(client);
+    }
+}
+
+static void
+broadcast()
+{
+    uint64_t count;
+    ssize_t r = read(wake_fd, &count, sizeof(count));
+    (void)r;
+    pthread_mutex_lock(&lock);
+    wire_buf_t* buf = outbox;
+    outbox          = NULL;
+    outbox_tail     = &outbox;
+    pthread_mutex_unlock(&lock);
+
+    while (buf != NULL) {
+        wire_buf_t* next = buf->next;
+        follow(buf);
+        for (int i = 0; i < SERVE_MAX_CLIENTS; i++) {
+            if (clients[i].fd >= 0 && enqueue(&clients[i], buf) != 0)
+                drop(&clients[i]);
+        }
+        unref(buf);
+        buf = next;
+    }
+    for (int i = 0; i < SERVE_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0 && !clients[i].writable_wait &&
+            send_pending(&clients[i]) != 0)
+            drop(&clients[i]);
+    }
+}
+
+// clients have nothing to say, so anything readable is a hangup
+static void
+client_event(client_t* client, unsigned int events)
+{
+    if (client->fd < 0)
+        return;
+    if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+        drop(client);
+        return;
+    }
+    if (events & EPOLLIN) {
+        char discard[256];
+        ssize_t n = read(client->fd, discard, sizeof(discard));
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            drop(client);
+            return;
+        }
+    }
+    if ((events & EPOLLOUT) && send_pending(client) != 0)
+        drop(client);
+}
+
+static int
+unsent()
+{
+    for (int i = 0; i < SERVE_MAX_CLIENTS; i++)
+        if (clients[i].fd >= 0 && clients[i].count > 0)
+            return 1;
+    return 0;
+}
+
+static void*
+serve_main(void* arg)
+{
+    struct epoll_event events[SERVE_EVENTS];
+    long long drain_until = -1;
+    int timeout           = -1;
+    for (;;) {
+        int n = epoll_wait(epoll_fd, events, SERVE_EVENTS, timeout);
+        if (n < 0 && errno != EINTR)
+            break;
+        for (int i = 0; i < n; i++) {
+            uint64_t tag = events[i].data.u64;
+            if (tag == SERVE_LISTENER)
+                accept_clients();
+            else if (tag == SERVE_WAKE)
+                broadcast();
+            else
+                client_event(&clients[tag - SERVE_CLIENT], events[i].events);
+        }
+        pthread_mutex_lock(&lock);
+        int stop = stopping && outbox == NULL;
+        pthread_mutex_unlock(&lock);
+        if (!stop)
+            continue;
+        // clients waiting for EPOLLOUT still get a bounded time
+        long long now = stats_now() / 1000000;
+        if (drain_until < 0)
+            drain_until = now + SERVE_DRAIN_MS;
+        if (!unsent() || now >= drain_until)
+            break;
+        timeout = (int)(drain_until - now);
+    }
+    return NULL;
+}
+
+static int
+add_fd(int fd, uint64_t tag)
+{
+    struct epoll_event ev = { EPOLLIN, { .u64 = tag } };
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* Listens on addr and starts the server thread. Returns -1 with errno
+ * set when the address cannot be used.
+ */
+int
+serve_start(const char* addr, const char** names, int count)
+{
+    for (int i = 0; i < SERVE_MAX_CLIENTS; i++)
+        clients[i].fd = -1;
+    listen_fd = net_listen(addr);
+    epoll_fd  = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd   = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (listen_fd < 0 || epoll_fd < 0 || wake_fd < 0 ||
+        add_fd(listen_fd, SERVE_LISTENER) != 0 ||
+        add_fd(wake_fd, SERVE_WAKE) != 0)
+        return -1;
+
+    channel_names = names;
+    channel_count = count;
+    record_decoder_reset(&shown);
+    record_stream(&encoder, names, count, sink, NULL);
+    return pthread_create(&thread, NULL, serve_main, NULL) == 0 ? 0 : -1;
+}
+
+/* Network thread, for every frame from upstream. */
+void
+serve_frame(const frame_t* frame)
+{
+    record_frame(&encoder, frame);
+}
+
+/* Network thread, at the end of every feed callback. */
+void
+serve_batch()
+{
+    record_flush(&encoder);
+}
+
+/* Sends what is left, waiting up to SERVE_DRAIN_MS for clients whose
+ * sockets are full, then disconnects every client.
+ */
+void
+serve_stop()
+{
+    record_close(&encoder);
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_mutex_unlock(&lock);
+    wake();
+    pthread_join(thread, NULL);
+
+    for (int i = 0; i < SERVE_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0)
+            drop(&clients[i]);
+    }
+    close(wake_fd);
+    close(epoll_fd);
+    close(listen_fd);
+}
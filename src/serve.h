@@ -0,0 +1,18 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "frame.h"
+
+int
+serve_start(const char* addr, const char** names, int count);
+
+void
+serve_frame(const frame_t* frame);
+
+void
+serve_batch();
+
+void
+serve_stop();
+
+#endif
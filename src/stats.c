@@ -0,0 +1,224 @@
+/* Statistics
+ *
+ * Counters and latency histograms for each stage between the socket
+ * and the screen. Every stage is only ever timed from one thread, while
+ * the overlay and the stats file read them from the render thread, so
+ * the cells are relaxed atomics: cheap to bump, never torn.
+ *
+ * Histograms have one bucket per power of two nanoseconds, which is
+ * plenty to tell a 50us decode from a 5ms flush and costs one count
+ * leading zeros per sample.
+ */
+
+#include "stats.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct
+{
+    atomic_size_t count;
+    atomic_llong total;
+    atomic_llong max;
+    atomic_size_t buckets[STATS_BUCKETS];
+} histogram_t;
+
+static histogram_t stages[STATS_STAGES];
+static atomic_size_t counters[STATS_COUNTERS];
+static const char* stage_names[STATS_STAGES] = {
+    "receive", "framing", "decode",  "position",
+    "flush",   "latency", "display", "feed_lag",
+};
+static int io_fd = -1;
+
+long long
+stats_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void
+stats_time(int stage, long long ns)
+{
+    histogram_t* h = &stages[stage];
+    if (ns < 1)
+        ns = 1;
+    int bucket = 63 - __builtin_clzll((unsigned long long)ns);
+    if (bucket >= STATS_BUCKETS)
+        bucket = STATS_BUCKETS - 1;
+    atomic_fetch_add_explicit(&h->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->total, ns, memory_order_relaxed);
+    // one writer per stage, so a plain compare is enough
+    if (ns > atomic_load_explicit(&h->max, memory_order_relaxed))
+        atomic_store_explicit(&h->max, ns, memory_order_relaxed);
+}
+
+void
+stats_add(int counter, size_t n)
+{
+    atomic_fetch_add_explicit(&counters[counter], n, memory_order_relaxed);
+}
+
+size_t
+stats_count(int stage)
+{
+    return atomic_load_explicit(&stages[stage].count, memory_order_relaxed);
+}
+
+size_t
+stats_counter(int counter)
+{
+    return atomic_load_explicit(&counters[counter], memory_order_relaxed);
+}
+
+/* Upper bound of the bucket holding the p-th fraction of samples,
+ * capped at the largest sample seen.
+ */
+long long
+stats_percentile(int stage, double p)
+{
+    histogram_t* h = &stages[stage];
+    size_t count   = atomic_load_explicit(&h->count, memory_order_relaxed);
+    long long max  = atomic_load_explicit(&h->max, memory_order_relaxed);
+    if (count == 0)
+        return 0;
+    size_t rank = (size_t)(p * (double)count), seen = 0;
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        seen += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+        if (seen > rank) {
+            long long bound = (2LL << b) - 1;
+            return bound < max ? bound : max;
+        }
+    }
+    return max;
+}
+
+/* Bytes written so far by the calling thread, from the kernel's I/O
+ * accounting. ncurses writes straight to its descriptor, so this is
+ * the only way to see what a flush put on the terminal. Returns 0 when
+ * the kernel does not provide it.
+ */
+size_t
+stats_thread_written()
+{
+    if (io_fd < 0)
+        io_fd = open("/proc/thread-self/io", O_RDONLY);
+    if (io_fd < 0)
+        return 0;
+    char buf[512];
+    ssize_t len = pread(io_fd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0)
+        return 0;
+    buf[len]          = '\0';
+    const char* wchar = strstr(buf, "wchar:");
+    return wchar != NULL ? strtoull(wchar + 6, NULL, 10) : 0;
+}
+
+static void
+format_ns(char* buf, size_t size, long long ns)
+{
+    if (ns < 1000)
+        snprintf(buf, size, "%lldns", ns);
+    else if (ns < 1000000)
+        snprintf(buf, size, "%.1fus", ns / 1e3);
+    else if (ns < 1000000000)
+        snprintf(buf, size, "%.1fms", ns / 1e6);
+    else
+        snprintf(buf, size, "%.1fs", ns / 1e9);
+}
+
+static void
+format_bytes(char* buf, size_t size, size_t bytes)
+{
+    if (bytes < 10240)
+        snprintf(buf, size, "%zuB", bytes);
+    else if (bytes < 10485760)
+        snprintf(buf, size, "%.1fKB", bytes / 1024.0);
+    else
+        snprintf(buf, size, "%.1fMB", bytes / 1048576.0);
+}
+
+/* The overlay: one line per stage and a line of byte counts. */
+size_t
+stats_format(char* buf, size_t size)
+{
+    size_t len = 0;
+    int n      = snprintf(
+      buf, size, "%-9s %9s %9s %9s %9s\n", "stage", "count", "p50", "p99", "max"
+    );
+    len += n > 0 ? (size_t)n : 0;
+    for (int i = 0; i < STATS_STAGES && len < size; i++) {
+        char p50[16], p99[16], max[16];
+        format_ns(p50, sizeof(p50), stats_percentile(i, 0.50));
+        format_ns(p99, sizeof(p99), stats_percentile(i, 0.99));
+        format_ns(
+          max,
+          sizeof(max),
+          atomic_load_explicit(&stages[i].max, memory_order_relaxed)
+        );
+        n = snprintf(
+          buf + len,
+          size - len,
+          "%-9s %9zu %9s %9s %9s\n",
+          stage_names[i],
+          stats_count(i),
+          p50,
+          p99,
+          max
+        );
+        len += n > 0 ? (size_t)n : 0;
+    }
+
+    char in[16], wire[16], out[16];
+    format_bytes(in, sizeof(in), stats_counter(STATS_BYTES_IN));
+    format_bytes(wire, sizeof(wire), stats_counter(STATS_BYTES_WIRE));
+    format_bytes(out, sizeof(out), stats_counter(STATS_BYTES_OUT));
+    if (len < size) {
+        n = snprintf(
+          buf + len,
+          size - len,
+          "received %s (%s on the wire), drawn %s",
+          in,
+          wire,
+          out
+        );
+        len += n > 0 ? (size_t)n : 0;
+    }
+    return len < size ? len : size - 1;
+}
+
+/* Appends one JSON object per line: wall clock time, the counters and
+ * count/p50/p99/max in nanoseconds for each stage.
+ */
+int
+stats_dump(FILE* out)
+{
+    fprintf(
+      out,
+      "{\"time\":%lld,\"bytes_in\":%zu,\"bytes_wire\":%zu,"
+      "\"bytes_out\":%zu",
+      (long long)time(NULL),
+      stats_counter(STATS_BYTES_IN),
+      stats_counter(STATS_BYTES_WIRE),
+      stats_counter(STATS_BYTES_OUT)
+    );
+    for (int i = 0; i < STATS_STAGES; i++) {
+        fprintf(
+          out,
+          ",\"%s\":{\"count\":%zu,\"p50\":%lld,\"p99\":%lld,\"max\":%lld}",
+          stage_names[i],
+          stats_count(i),
+          stats_percentile(i, 0.50),
+          stats_percentile(i, 0.99),
+          atomic_load_explicit(&stages[i].max, memory_order_relaxed)
+        );
+    }
+    fputs("}\n", out);
+    return fflush(out);
+}
@@ -0,0 +1,57 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// timed stages of the pipeline
+#define STATS_RECEIVE  0
+#define STATS_FRAMING  1
+#define STATS_DECODE   2
+#define STATS_POSITION 3
+#define STATS_FLUSH    4
+// socket to screen, decoded to screen, and the clock based feed lag
+#define STATS_LATENCY  5
+#define STATS_DISPLAY  6
+#define STATS_FEED_LAG 7
+#define STATS_STAGES   8
+
+// plain counters; bytes in are after and wire bytes before decompression
+#define STATS_BYTES_IN   0
+#define STATS_BYTES_OUT  1
+#define STATS_BYTES_WIRE 2
+#define STATS_COUNTERS   3
+
+// histogram buckets are powers of two nanoseconds
+#define STATS_BUCKETS 40
+
+#define STATS_OVERLAY_MAX 1024
+
+long long
+stats_now();
+
+void
+stats_time(int stage, long long ns);
+
+void
+stats_add(int counter, size_t n);
+
+size_t
+stats_count(int stage);
+
+long long
+stats_percentile(int stage, double p);
+
+size_t
+stats_counter(int counter);
+
+size_t
+stats_thread_written();
+
+size_t
+stats_format(char* buf, size_t size);
+
+int
+stats_dump(FILE* out);
+
+#endif